@@ -0,0 +1,120 @@
+#include "SyntheticData.h"
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+namespace {
+const float strokeDensity = 0.2f;
+const float noiseLevel = 0.15f;
+const unsigned int patternSeed = 12345;  // Shared by all sets so train and test classes match
+
+void writeBigEndian(std::ofstream& file, uint32_t value) {
+    unsigned char bytes[4] = {
+        static_cast<unsigned char>(value >> 24), static_cast<unsigned char>(value >> 16),
+        static_cast<unsigned char>(value >> 8), static_cast<unsigned char>(value)
+    };
+    file.write(reinterpret_cast<const char*>(bytes), 4);
+}
+
+// Magic, version 1.0, then the dict header padded with spaces so the data
+// starts on a 64-byte boundary
+void writeNpyHeader(std::ofstream& file, const std::string& descr, const std::string& shape) {
+    std::string header = "{'descr': '" + descr + "', 'fortran_order': False, 'shape': " + shape + ", }";
+    size_t total = 10 + header.size() + 1;
+    header.append((64 - total % 64) % 64, ' ');
+    header += '\n';
+
+    uint16_t headerLength = static_cast<uint16_t>(header.size());
+    file.write("\x93NUMPY\x01\x00", 8);
+    file.put(static_cast<char>(headerLength & 0xff));
+    file.put(static_cast<char>(headerLength >> 8));
+    file.write(header.data(), header.size());
+}
+
+unsigned char toByte(float pixel) {
+    return static_cast<unsigned char>(std::min(255.0f, std::max(0.0f, pixel * 255.0f + 0.5f)));
+}
+}
+
+std::vector<MNISTImage> SyntheticData::generate(int count, int rows, int cols, int numClasses, unsigned int seed) {
+    std::mt19937 patternRng(patternSeed);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    size_t pixels = static_cast<size_t>(rows) * cols;
+
+    std::vector<std::vector<float>> patterns(numClasses, std::vector<float>(pixels));
+    for (auto& pattern : patterns) {
+        for (float& value : pattern) {
+            value = uniform(patternRng) < strokeDensity ? 0.7f + 0.3f * uniform(patternRng) : 0.0f;
+        }
+    }
+
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(0.0f, noiseLevel);
+
+    std::vector<MNISTImage> images(count);
+    for (int i = 0; i < count; ++i) {
+        MNISTImage& image = images[i];
+        image.label = static_cast<int>(rng() % numClasses);
+        image.type = DatasetType::MNIST;
+        image.pixels.resize(pixels);
+
+        const std::vector<float>& pattern = patterns[image.label];
+        for (size_t p = 0; p < pixels; ++p) {
+            image.pixels[p] = toByte(pattern[p] + noise(rng)) / 255.0f;
+        }
+    }
+    return images;
+}
+
+bool SyntheticData::writeIdx(const std::vector<MNISTImage>& images, int rows, int cols,
+                             const std::string& imagesPath, const std::string& labelsPath) {
+    std::ofstream imageFile(imagesPath, std::ios::binary);
+    std::ofstream labelFile(labelsPath, std::ios::binary);
+    if (!imageFile || !labelFile) {
+        std::cerr << "Cannot create IDX files " << imagesPath << ", " << labelsPath << std::endl;
+        return false;
+    }
+
+    writeBigEndian(imageFile, 0x00000803);
+    writeBigEndian(imageFile, static_cast<uint32_t>(images.size()));
+    writeBigEndian(imageFile, static_cast<uint32_t>(rows));
+    writeBigEndian(imageFile, static_cast<uint32_t>(cols));
+    writeBigEndian(labelFile, 0x00000801);
+    writeBigEndian(labelFile, static_cast<uint32_t>(images.size()));
+
+    std::vector<unsigned char> buffer(static_cast<size_t>(rows) * cols);
+    for (const auto& image : images) {
+        std::transform(image.pixels.begin(), image.pixels.end(), buffer.begin(), toByte);
+        imageFile.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+        labelFile.put(static_cast<char>(image.label));
+    }
+    return imageFile.good() && labelFile.good();
+}
+
+bool SyntheticData::writeNpy(const std::vector<MNISTImage>& images, int rows, int cols,
+                             const std::string& imagesPath, const std::string& labelsPath) {
+    std::ofstream imageFile(imagesPath, std::ios::binary);
+    std::ofstream labelFile(labelsPath, std::ios::binary);
+    if (!imageFile || !labelFile) {
+        std::cerr << "Cannot create NPY files " << imagesPath << ", " << labelsPath << std::endl;
+        return false;
+    }
+
+    std::ostringstream shape;
+    shape << "(" << images.size() << ", " << rows << ", " << cols << ")";
+    writeNpyHeader(imageFile, "|u1", shape.str());
+    writeNpyHeader(labelFile, "<i8", "(" + std::to_string(images.size()) + ",)");
+
+    std::vector<unsigned char> buffer(static_cast<size_t>(rows) * cols);
+    for (const auto& image : images) {
+        std::transform(image.pixels.begin(), image.pixels.end(), buffer.begin(), toByte);
+        imageFile.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+
+        int64_t label = image.label;  // NPY headers above declare little-endian
+        labelFile.write(reinterpret_cast<const char*>(&label), sizeof(label));
+    }
+    return imageFile.good() && labelFile.good();
+}
@@ -0,0 +1,25 @@
+#ifndef SYNTHETICDATA_H
+#define SYNTHETICDATA_H
+
+#include "MNISTLoader.h"
+#include <string>
+#include <vector>
+
+// MNIST-like data for benchmarks: each class is a fixed random pattern of bright
+// strokes on a dark background (the same for every seed, so sets generated with
+// different seeds share classes) and samples add noise to it. Pixels are quantized
+// to 8 bits so the in-memory samples match what the loaders return for the files.
+class SyntheticData {
+public:
+    static std::vector<MNISTImage> generate(int count, int rows, int cols,
+                                            int numClasses = 10, unsigned int seed = 1);
+
+    // IDX files as distributed with MNIST (big-endian header, ubyte payload)
+    static bool writeIdx(const std::vector<MNISTImage>& images, int rows, int cols,
+                         const std::string& imagesPath, const std::string& labelsPath);
+    // NPY v1.0 files: uint8 images of shape (count, rows, cols) and int64 labels
+    static bool writeNpy(const std::vector<MNISTImage>& images, int rows, int cols,
+                         const std::string& imagesPath, const std::string& labelsPath);
+};
+
+#endif
@@ -0,0 +1,326 @@
+#include "KohonenNetwork.h"
+#include "DatasetCache.h"
+#include "DistanceKernels.h"
+#include "MNISTLoader.h"
+#include "NpyFile.h"
+#include "NpyLoader.h"
+#include "ThreadPool.h"
+#include "SyntheticData.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+namespace {
+struct BenchOptions {
+    std::vector<int> latticeSizes = {4, 8, 12, 16};
+    std::vector<int> imageSides = {8, 16, 28};  // input size is side^2
+    int samples = 2000;
+    double minSeconds = 0.2;
+    int repeats = 3;
+    int threads = 0;
+    std::string format = "json";
+    std::string outputPath;
+    std::string dataDir;
+    bool verbose = false;
+};
+
+struct BenchResult {
+    std::string name;
+    int lattice;        // edge length of the cubic map (0 for loader benchmarks)
+    int inputSize;
+    int itemsPerOp;     // samples processed by one timed operation
+    long long iterations;
+    double nsPerOp;     // best of the repeats
+};
+
+typedef std::chrono::steady_clock Clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Library code logs progress to std::cout; results may go there too, so it is
+// muted while benchmarks run unless --verbose is given
+class QuietScope {
+public:
+    explicit QuietScope(bool enabled) : saved(enabled ? std::cout.rdbuf(nullptr) : nullptr) {}
+    ~QuietScope() { if (saved) std::cout.rdbuf(saved); }
+
+private:
+    std::streambuf* saved;
+};
+
+volatile float sink;
+
+// Micro benchmark: doubles the batch until one batch runs for minSeconds, then
+// keeps the fastest of `repeats` such batches
+template <typename Operation>
+BenchResult measure(const std::string& name, int lattice, int inputSize, const BenchOptions& options,
+                    Operation operation) {
+    long long batch = 1;
+    while (true) {
+        auto start = Clock::now();
+        for (long long i = 0; i < batch; ++i) operation(i);
+        if (secondsSince(start) >= options.minSeconds || batch >= (1LL << 40)) break;
+        batch *= 2;
+    }
+
+    double best = 1e300;
+    for (int r = 0; r < options.repeats; ++r) {
+        auto start = Clock::now();
+        for (long long i = 0; i < batch; ++i) operation(i);
+        best = std::min(best, secondsSince(start) * 1e9 / batch);
+    }
+    return {name, lattice, inputSize, 1, batch * options.repeats, best};
+}
+
+// Macro benchmark: one timed call per repeat, with untimed setup before each
+template <typename Setup, typename Operation>
+BenchResult measureOnce(const std::string& name, int lattice, int inputSize, int items,
+                        const BenchOptions& options, Setup setup, Operation operation) {
+    double best = 1e300;
+    for (int r = 0; r < options.repeats; ++r) {
+        setup();
+        auto start = Clock::now();
+        operation();
+        best = std::min(best, secondsSince(start) * 1e9);
+    }
+    return {name, lattice, inputSize, items, options.repeats, best};
+}
+
+void benchmarkLoaders(int side, const std::vector<MNISTImage>& images, const BenchOptions& options,
+                      std::vector<BenchResult>& results) {
+    std::string stem = options.dataDir + "/synthetic_" + std::to_string(side);
+    std::string idxImages = stem + "-images-idx3-ubyte";
+    std::string idxLabels = stem + "-labels-idx1-ubyte";
+    std::string npyImages = stem + "_images.npy";
+    std::string npyLabels = stem + "_labels.npy";
+    if (!SyntheticData::writeIdx(images, side, side, idxImages, idxLabels) ||
+        !SyntheticData::writeNpy(images, side, side, npyImages, npyLabels)) {
+        return;
+    }
+
+    int inputSize = side * side;
+    int count = static_cast<int>(images.size());
+    QuietScope quiet(!options.verbose);
+
+    // The parse cases always decode; the cached case keeps its entry next to the data
+    std::string cacheDirectory = DatasetCache::getDirectory();
+    DatasetCache::setDirectory("");
+
+    results.push_back(measureOnce("mnist_loader_parse", 0, inputSize, count, options, [] {}, [&] {
+        sink = MNISTLoader::loadDataset(idxImages, idxLabels).sample(count - 1)[0];
+    }));
+    results.push_back(measureOnce("mnist_loader_map", 0, inputSize, count, options, [] {}, [&] {
+        std::shared_ptr<IdxFile> imageFile, labelFile;
+        if (MNISTLoader::mapData(idxImages, idxLabels, imageFile, labelFile)) {
+            sink = imageFile->matrix().row(count - 1)[0] + labelFile->data()[count - 1];
+        }
+    }));
+    results.push_back(measureOnce("npy_loader_parse", 0, inputSize, count, options, [] {}, [&] {
+        sink = NpyLoader::load(npyImages).data.back() + NpyLoader::load(npyLabels).data.back();
+    }));
+    results.push_back(measureOnce("npy_loader_map", 0, inputSize, count, options, [] {}, [&] {
+        std::shared_ptr<NpyFile> imageFile = NpyFile::open(npyImages);
+        if (imageFile) sink = imageFile->matrix().row(count - 1)[0];
+    }));
+
+    DatasetCache::setDirectory(options.dataDir);
+    DatasetCacheKey cacheKey;
+    MNISTLoader::loadDataset(idxImages, idxLabels);
+    results.push_back(measureOnce("mnist_loader_cached", 0, inputSize, count, options, [] {}, [&] {
+        sink = MNISTLoader::loadDataset(idxImages, idxLabels).sample(count - 1)[0];
+    }));
+    DatasetCache::find({idxImages, idxLabels}, -1, cacheKey);
+    std::remove(cacheKey.path.c_str());
+    DatasetCache::setDirectory(cacheDirectory);
+
+    for (const std::string& path : {idxImages, idxLabels, npyImages, npyLabels}) {
+        std::remove(path.c_str());
+    }
+}
+
+void benchmarkNetwork(int lattice, int side, const std::vector<MNISTImage>& trainImages,
+                      const Dataset& trainSet, const Dataset& testSet, const BenchOptions& options,
+                      std::vector<BenchResult>& results) {
+    int inputSize = side * side;
+    float radius = std::max(1.0f, lattice / 4.0f);
+    size_t numSamples = trainSet.size();
+    QuietScope quiet(!options.verbose);
+
+    KohonenNetwork network(lattice, lattice, lattice, inputSize);
+    network.setNumThreads(options.threads);
+    network.setSeed(1);
+    network.initialize();
+    int numNeurons = network.getNumNeurons();
+
+    results.push_back(measure("calculate_distance", lattice, inputSize, options, [&](long long i) {
+        sink = network.calculateDistance(trainImages[i % numSamples].pixels, static_cast<int>(i % numNeurons));
+    }));
+    results.push_back(measure("find_best_matching_unit", lattice, inputSize, options, [&](long long i) {
+        sink = static_cast<float>(network.findBestMatchingUnit(trainImages[i % numSamples].pixels));
+    }));
+    results.push_back(measure("get_neighbors", lattice, inputSize, options, [&](long long i) {
+        sink = static_cast<float>(network.getNeighbors(static_cast<int>(i % numNeurons), radius).size());
+    }));
+    results.push_back(measure("train_step", lattice, inputSize, options, [&](long long i) {
+        network.trainStep(trainSet.sample(i % numSamples), 0.1f, radius);
+    }));
+
+    results.push_back(measureOnce("train_epoch", lattice, inputSize, static_cast<int>(numSamples), options,
+                                  [&] { network.setSeed(1); network.initialize(); },
+                                  [&] { network.train(trainSet, 1); }));
+    results.push_back(measureOnce("evaluate_on_dataset", lattice, inputSize, static_cast<int>(testSet.size()),
+                                  options, [] {}, [&] {
+        sink = network.evaluateOnDataset(testSet).accuracy;
+    }));
+}
+
+void writeJson(std::ostream& out, const std::vector<BenchResult>& results, const BenchOptions& options) {
+    out << "{\n";
+    out << "  \"isa\": \"" << DistanceKernels::isaName(DistanceKernels::activeIsa()) << "\",\n";
+    out << "  \"threads\": " << (options.threads > 0 ? options.threads : ThreadPool::defaultThreadCount()) << ",\n";
+    out << "  \"min_time_seconds\": " << options.minSeconds << ",\n";
+    out << "  \"repeats\": " << options.repeats << ",\n";
+    out << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"lattice\": " << r.lattice
+            << ", \"neurons\": " << r.lattice * r.lattice * r.lattice
+            << ", \"input_size\": " << r.inputSize << ", \"items_per_op\": " << r.itemsPerOp
+            << ", \"iterations\": " << r.iterations << ", \"ns_per_op\": " << r.nsPerOp
+            << ", \"items_per_second\": " << r.itemsPerOp * 1e9 / r.nsPerOp << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+void writeCsv(std::ostream& out, const std::vector<BenchResult>& results) {
+    out << "name,lattice,neurons,input_size,items_per_op,iterations,ns_per_op,items_per_second\n";
+    for (const BenchResult& r : results) {
+        out << r.name << "," << r.lattice << "," << r.lattice * r.lattice * r.lattice << ","
+            << r.inputSize << "," << r.itemsPerOp << "," << r.iterations << ","
+            << r.nsPerOp << "," << r.itemsPerOp * 1e9 / r.nsPerOp << "\n";
+    }
+}
+
+std::vector<int> parseList(const std::string& text) {
+    std::vector<int> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        int value = std::atoi(item.c_str());
+        if (value > 0) values.push_back(value);
+    }
+    return values;
+}
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--quick] [--lattice 4,8,...] [--image-side 8,16,28]"
+              << " [--samples N] [--min-time S] [--repeats N] [--threads N]"
+              << " [--isa scalar|sse2|avx2|avx512] [--format json|csv] [--output file]"
+              << " [--data-dir dir] [--verbose]" << std::endl;
+}
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--quick") {
+            options.latticeSizes = {4, 8};
+            options.imageSides = {8, 28};
+            options.samples = 500;
+            options.minSeconds = 0.05;
+        } else if (arg == "--lattice" && hasValue) {
+            options.latticeSizes = parseList(argv[++i]);
+        } else if (arg == "--image-side" && hasValue) {
+            options.imageSides = parseList(argv[++i]);
+        } else if (arg == "--samples" && hasValue) {
+            options.samples = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--min-time" && hasValue) {
+            options.minSeconds = std::atof(argv[++i]);
+        } else if (arg == "--repeats" && hasValue) {
+            options.repeats = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--threads" && hasValue) {
+            options.threads = std::atoi(argv[++i]);
+        } else if (arg == "--isa" && hasValue) {
+            std::string name = argv[++i];
+            KernelIsa isa = name == "scalar" ? KernelIsa::Scalar : name == "sse2" ? KernelIsa::SSE2
+                          : name == "avx2" ? KernelIsa::AVX2 : KernelIsa::AVX512;
+            if (!DistanceKernels::setIsa(isa)) {
+                std::cerr << "ISA " << name << " is not supported on this CPU" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--format" && hasValue) {
+            options.format = argv[++i];
+        } else if (arg == "--output" && hasValue) {
+            options.outputPath = argv[++i];
+        } else if (arg == "--data-dir" && hasValue) {
+            options.dataDir = argv[++i];
+        } else if (arg == "--verbose") {
+            options.verbose = true;
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (options.format != "json" && options.format != "csv") {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    bool ownDataDir = options.dataDir.empty();
+    if (ownDataDir) {
+        char pattern[] = "/tmp/kohonen_bench_XXXXXX";
+        if (!mkdtemp(pattern)) {
+            std::cerr << "Cannot create a temporary data directory" << std::endl;
+            return 1;
+        }
+        options.dataDir = pattern;
+    }
+
+    std::vector<BenchResult> results;
+    for (int side : options.imageSides) {
+        std::vector<MNISTImage> trainImages = SyntheticData::generate(options.samples, side, side, 10, 1);
+        Dataset trainSet = Dataset::fromImages(trainImages);
+        Dataset testSet = Dataset::fromImages(
+            SyntheticData::generate(std::max(1, options.samples / 4), side, side, 10, 2));
+
+        std::cerr << "Input " << side << "x" << side << ": loaders" << std::endl;
+        benchmarkLoaders(side, trainImages, options, results);
+
+        for (int lattice : options.latticeSizes) {
+            std::cerr << "Input " << side << "x" << side << ": " << lattice << "^3 lattice" << std::endl;
+            benchmarkNetwork(lattice, side, trainImages, trainSet, testSet, options, results);
+        }
+    }
+
+    if (ownDataDir) rmdir(options.dataDir.c_str());
+
+    std::ofstream file;
+    if (!options.outputPath.empty()) {
+        file.open(options.outputPath);
+        if (!file) {
+            std::cerr << "Cannot write " << options.outputPath << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = options.outputPath.empty() ? std::cout : file;
+    if (options.format == "csv") {
+        writeCsv(out, results);
+    } else {
+        writeJson(out, results, options);
+    }
+    return 0;
+}
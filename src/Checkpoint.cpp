@@ -0,0 +1,201 @@
+#include "Checkpoint.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <unistd.h>
+
+namespace {
+const char checkpointMagic[8] = {'K', 'S', 'O', 'M', 'C', 'K', 'P', 'T'};
+const uint32_t checkpointVersion = 3;
+
+template <typename T>
+void writeValue(std::ofstream& file, const T& value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+void writeArray(std::ofstream& file, const std::vector<T>& values) {
+    writeValue(file, static_cast<uint64_t>(values.size()));
+    file.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+}
+
+template <typename T>
+bool readValue(std::ifstream& file, T& value) {
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+template <typename T>
+bool readArray(std::ifstream& file, std::vector<T>& values, uint64_t limit) {
+    uint64_t count;
+    if (!readValue(file, count) || count > limit) return false;
+    values.resize(count);
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(values.data()),
+                                       static_cast<std::streamsize>(count * sizeof(T))));
+}
+}
+
+bool TrainingCheckpoint::save(const std::string& filename) const {
+    // Unique per process and call, so two writers of the same checkpoint never
+    // rename each other's half-written file into place
+    static std::atomic<unsigned> sequence(0);
+    std::string temporary = filename + ".tmp" + std::to_string(getpid()) + "." + std::to_string(sequence++);
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << "Cannot create checkpoint: " << temporary << std::endl;
+            return false;
+        }
+
+        file.write(checkpointMagic, sizeof(checkpointMagic));
+        writeValue(file, checkpointVersion);
+        writeValue(file, width);
+        writeValue(file, height);
+        writeValue(file, depth);
+        writeValue(file, inputSize);
+        writeValue(file, epoch);
+        writeValue(file, totalEpochs);
+        writeValue(file, learningRate);
+        writeValue(file, neighborhoodRadius);
+        writeValue(file, initialLearningRate);
+        writeValue(file, initialRadius);
+        writeValue(file, decayRate);
+        writeValue(file, trainingMode);
+        writeValue(file, datasetType);
+        writeValue(file, shuffleBlockSize);
+        writeValue(file, approximateRescanInterval);
+        writeValue(file, approximateRecall);
+        writeArray(file, std::vector<char>(rngState.begin(), rngState.end()));
+        writeArray(file, weights);
+        writeArray(file, activationCounts);
+        writeArray(file, sampleOrder);
+        writeArray(file, seedBmus);
+        writeArray(file, quantizationErrors);
+
+        if (!file.good()) {
+            std::cerr << "Failed writing checkpoint: " << temporary << std::endl;
+            file.close();
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+
+    if (std::rename(temporary.c_str(), filename.c_str()) != 0) {
+        std::cerr << "Cannot replace checkpoint: " << filename << std::endl;
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool TrainingCheckpoint::load(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Cannot open checkpoint: " << filename << std::endl;
+        return false;
+    }
+
+    char magic[sizeof(checkpointMagic)];
+    uint32_t version = 0;
+    if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, checkpointMagic, sizeof(magic)) != 0 ||
+        !readValue(file, version) || version != checkpointVersion) {
+        std::cerr << "Not a checkpoint of this version: " << filename << std::endl;
+        return false;
+    }
+
+    const uint64_t maxElements = uint64_t(1) << 40;
+    std::vector<char> rngText;
+    bool ok = readValue(file, width) && readValue(file, height) && readValue(file, depth) &&
+              readValue(file, inputSize) && readValue(file, epoch) && readValue(file, totalEpochs) &&
+              readValue(file, learningRate) && readValue(file, neighborhoodRadius) &&
+              readValue(file, initialLearningRate) && readValue(file, initialRadius) &&
+              readValue(file, decayRate) &&
+              readValue(file, trainingMode) && readValue(file, datasetType) &&
+              readValue(file, shuffleBlockSize) && readValue(file, approximateRescanInterval) &&
+              readValue(file, approximateRecall) &&
+              readArray(file, rngText, maxElements) && readArray(file, weights, maxElements) &&
+              readArray(file, activationCounts, maxElements) && readArray(file, sampleOrder, maxElements) &&
+              readArray(file, seedBmus, maxElements) && readArray(file, quantizationErrors, maxElements);
+    if (!ok) {
+        std::cerr << "Truncated checkpoint: " << filename << std::endl;
+        return false;
+    }
+
+    rngState.assign(rngText.begin(), rngText.end());
+    return true;
+}
+
+CheckpointWriter::CheckpointWriter(const std::string& filename)
+: filename(filename), states{BufferState::Free, BufferState::Free}, stopping(false) {
+    thread = std::thread(&CheckpointWriter::writerLoop, this);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeCondition.notify_one();
+    thread.join();
+}
+
+TrainingCheckpoint& CheckpointWriter::acquire() {
+    std::lock_guard<std::mutex> lock(mutex);
+    // With one writer at most one buffer is Writing, so one of these always exists
+    for (int i = 0; i < 2; ++i) {
+        if (states[i] == BufferState::Free) {
+            states[i] = BufferState::Filling;
+            return buffers[i];
+        }
+    }
+    int stale = states[0] == BufferState::Pending ? 0 : 1;
+    states[stale] = BufferState::Filling;
+    return buffers[stale];
+}
+
+void CheckpointWriter::submit(TrainingCheckpoint& checkpoint) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        states[&checkpoint == &buffers[0] ? 0 : 1] = BufferState::Pending;
+    }
+    wakeCondition.notify_one();
+}
+
+void CheckpointWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idleCondition.wait(lock, [this] {
+        return states[0] != BufferState::Pending && states[0] != BufferState::Writing &&
+               states[1] != BufferState::Pending && states[1] != BufferState::Writing;
+    });
+}
+
+void CheckpointWriter::writerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wakeCondition.wait(lock, [this] {
+            return stopping || states[0] == BufferState::Pending || states[1] == BufferState::Pending;
+        });
+
+        int next = states[0] == BufferState::Pending ? 0 : (states[1] == BufferState::Pending ? 1 : -1);
+        if (next < 0) return;  // Stopping with nothing left to write
+
+        // Both buffers can be pending if the trainer was quicker than this thread
+        // woke up; only the newer one is worth writing
+        int other = 1 - next;
+        if (states[other] == BufferState::Pending) {
+            if (buffers[other].epoch > buffers[next].epoch) std::swap(next, other);
+            states[other] = BufferState::Free;
+        }
+
+        states[next] = BufferState::Writing;
+        lock.unlock();
+        buffers[next].save(filename);
+        lock.lock();
+        states[next] = BufferState::Free;
+        idleCondition.notify_all();
+    }
+}
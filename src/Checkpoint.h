@@ -0,0 +1,73 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Everything train() needs to continue after the epoch a checkpoint was taken at
+struct TrainingCheckpoint {
+    int32_t width, height, depth;
+    int32_t inputSize;
+    int32_t epoch;        // Last completed epoch
+    int32_t totalEpochs;  // Length of the learning rate / radius schedule
+    float learningRate;   // Schedule values used by that epoch
+    float neighborhoodRadius;
+    float initialLearningRate;  // TrainingSchedule of the run
+    float initialRadius;
+    float decayRate;
+    int32_t trainingMode;
+    int32_t datasetType;
+    uint64_t shuffleBlockSize;
+    int32_t approximateRescanInterval;
+    float approximateRecall;
+    std::string rngState;  // std::mt19937 in its textual form
+    std::vector<float> weights;  // numNeurons x inputSize
+    std::vector<int32_t> activationCounts;
+    std::vector<uint32_t> sampleOrder;
+    std::vector<int32_t> seedBmus;
+    std::vector<float> quantizationErrors;  // Per-epoch QE so far (drives early stopping)
+
+    // Written to a temporary file and renamed, so a crash never leaves a torn checkpoint
+    bool save(const std::string& filename) const;
+    bool load(const std::string& filename);
+};
+
+// Writes checkpoints from a background thread. The trainer fills one of two
+// snapshot buffers while the other may be on its way to disk; if both are in
+// use, the older checkpoint that has not started writing is replaced, so
+// acquire() never waits for I/O.
+class CheckpointWriter {
+public:
+    explicit CheckpointWriter(const std::string& filename);
+    ~CheckpointWriter();
+
+    CheckpointWriter(const CheckpointWriter&) = delete;
+    CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+    TrainingCheckpoint& acquire();
+    void submit(TrainingCheckpoint& checkpoint);
+    // Blocks until every submitted checkpoint is on disk
+    void flush();
+
+    const std::string& path() const { return filename; }
+
+private:
+    enum class BufferState { Free, Filling, Pending, Writing };
+
+    std::string filename;
+    TrainingCheckpoint buffers[2];
+    BufferState states[2];
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable idleCondition;
+    bool stopping;
+    std::thread thread;
+
+    void writerLoop();
+};
+
+#endif
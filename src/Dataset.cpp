@@ -0,0 +1,84 @@
+#include "Dataset.h"
+#include "MappedFile.h"
+#include <algorithm>
+
+Dataset::Dataset()
+: storage(std::make_shared<Storage>()), offset(0), count(0), inputSize(0), stride(0),
+type(DatasetType::MNIST) {
+}
+
+MutableDataset::MutableDataset(size_t count, int inputSize, DatasetType type) {
+    this->count = count;
+    this->inputSize = inputSize;
+    this->stride = (static_cast<size_t>(inputSize) + 15) & ~static_cast<size_t>(15);
+    this->type = type;
+    storage->values.assign(count * stride, 0.0f);
+    storage->labels.assign(count, -1);
+    storage->data = storage->values.data();
+    storage->labelData = storage->labels.data();
+}
+
+MutableDataset MutableDataset::slice(size_t begin, size_t end) const {
+    MutableDataset view = *this;
+    static_cast<Dataset&>(view) = Dataset::slice(begin, end);
+    return view;
+}
+
+Dataset Dataset::fromMapping(std::shared_ptr<MappedFile> file, const float* values, const int32_t* labels,
+                             size_t count, int inputSize, DatasetType type) {
+    Dataset dataset;
+    dataset.count = count;
+    dataset.inputSize = inputSize;
+    dataset.stride = (static_cast<size_t>(inputSize) + 15) & ~static_cast<size_t>(15);
+    dataset.type = type;
+    dataset.storage->file = file;
+    dataset.storage->data = values;
+    dataset.storage->labelData = labels;
+    return dataset;
+}
+
+Dataset Dataset::fromImages(const std::vector<MNISTImage>& images) {
+    if (images.empty()) return Dataset();
+
+    MutableDataset dataset(images.size(), static_cast<int>(images[0].pixels.size()), images[0].type);
+    for (size_t i = 0; i < images.size(); ++i) {
+        const std::vector<float>& pixels = images[i].pixels;
+        std::copy(pixels.begin(), pixels.begin() + std::min<size_t>(pixels.size(), dataset.inputSize),
+                  dataset.sample(i));
+        dataset.setLabel(i, images[i].label);
+    }
+    return dataset;
+}
+
+Dataset Dataset::slice(size_t begin, size_t end) const {
+    Dataset view = *this;
+    end = std::min(end, count);
+    begin = std::min(begin, end);
+    view.offset = offset + begin;
+    view.count = end - begin;
+    return view;
+}
+
+Dataset Dataset::subset(const std::vector<uint32_t>& indices) const {
+    auto rows = std::make_shared<std::vector<uint32_t>>(indices.size());
+    for (size_t i = 0; i < indices.size(); ++i) {
+        (*rows)[i] = static_cast<uint32_t>(row(indices[i]));
+    }
+
+    Dataset view = *this;
+    view.rowIndices = rows;
+    view.offset = 0;
+    view.count = indices.size();
+    return view;
+}
+
+std::vector<MNISTImage> Dataset::toImages() const {
+    std::vector<MNISTImage> images(count);
+    for (size_t i = 0; i < count; ++i) {
+        const float* values = sample(i);
+        images[i].pixels.assign(values, values + inputSize);
+        images[i].label = label(i);
+        images[i].type = type;
+    }
+    return images;
+}
@@ -0,0 +1,94 @@
+#ifndef DATASET_H
+#define DATASET_H
+
+#include "AlignedAllocator.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class MappedFile;
+
+enum class DatasetType {
+    MNIST,
+    FASHION_MNIST
+};
+
+struct MNISTImage {
+    std::vector<float> pixels;  // Normalized to [0,1]
+    int label;
+    DatasetType type;
+};
+
+// Samples as one sample-major float matrix, 64-byte aligned with rows padded to
+// a multiple of 16 floats (the layout of the weight matrix), plus a label per
+// sample. Copies, slices and subsets are views sharing the same storage. A
+// Dataset is read-only: samples are written through a MutableDataset, the only
+// kind that allocates, so one over a read-only file mapping (see DatasetCache)
+// has no way to be written through.
+class Dataset {
+public:
+    Dataset();
+    static Dataset fromImages(const std::vector<MNISTImage>& images);
+    // Samples stored in a mapped file as rows of the stride above, the first row
+    // 64-byte aligned, and one int32 label per sample
+    static Dataset fromMapping(std::shared_ptr<MappedFile> file, const float* values, const int32_t* labels,
+                               size_t count, int inputSize, DatasetType type);
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    int getInputSize() const { return inputSize; }
+    // Floats between the starts of consecutive storage rows
+    size_t getStride() const { return stride; }
+    DatasetType getType() const { return type; }
+    void setType(DatasetType newType) { type = newType; }
+
+    const float* sample(size_t index) const { return storage->data + row(index) * stride; }
+    int label(size_t index) const { return storage->labelData[row(index)]; }
+    bool isMapped() const { return storage->file != nullptr; }
+
+    // Samples [begin, end) of this view
+    Dataset slice(size_t begin, size_t end) const;
+    // The listed samples of this view, in list order
+    Dataset subset(const std::vector<uint32_t>& indices) const;
+    // True when sample(i + 1) == sample(i) + getStride() throughout
+    bool isContiguous() const { return !rowIndices; }
+
+    std::vector<MNISTImage> toImages() const;
+
+protected:
+    struct Storage {
+        AlignedVector<float> values;
+        std::vector<int32_t> labels;
+        std::shared_ptr<MappedFile> file;  // Owner of data and labelData when mapped
+        const float* data = nullptr;       // values, or the mapped samples
+        const int32_t* labelData = nullptr;
+    };
+
+    std::shared_ptr<Storage> storage;
+    std::shared_ptr<const std::vector<uint32_t>> rowIndices;  // Null: rows offset .. offset + count
+    size_t offset;
+    size_t count;
+    int inputSize;
+    size_t stride;
+    DatasetType type;
+
+    size_t row(size_t index) const { return rowIndices ? (*rowIndices)[offset + index] : offset + index; }
+};
+
+// A Dataset over storage of its own, which can be filled in. Converting it to a
+// Dataset gives a read-only view of the same storage.
+class MutableDataset : public Dataset {
+public:
+    MutableDataset() {}
+    MutableDataset(size_t count, int inputSize, DatasetType type = DatasetType::MNIST);
+
+    using Dataset::sample;
+    float* sample(size_t index) { return storage->values.data() + row(index) * stride; }
+    void setLabel(size_t index, int label) { storage->labels[row(index)] = label; }
+
+    // Samples [begin, end) of this view, still writable
+    MutableDataset slice(size_t begin, size_t end) const;
+};
+
+#endif
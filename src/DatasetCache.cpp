@@ -0,0 +1,223 @@
+#include "DatasetCache.h"
+#include "MappedFile.h"
+#include <atomic>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+const char cacheMagic[8] = {'K', 'S', 'O', 'M', 'D', 'S', 'C', '\0'};
+const uint64_t sectionAlignment = 64;
+const size_t maxSources = 2;
+
+uint64_t alignSection(uint64_t offset) {
+    return (offset + sectionAlignment - 1) & ~(sectionAlignment - 1);
+}
+
+bool isLittleEndian() {
+    const uint16_t probe = 1;
+    unsigned char first;
+    std::memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+// FNV-1a over 64-bit words: a change detector for sources, not a defense
+// against crafted collisions. One multiply per 8 bytes keeps hashing far
+// cheaper than decoding.
+uint64_t hashBytes(const unsigned char* data, size_t size) {
+    const uint64_t prime = 0x100000001b3ULL;
+    uint64_t hash = 0xcbf29ce484222325ULL ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * prime;
+    }
+    for (; i < size; ++i) {
+        hash = (hash ^ data[i]) * prime;
+    }
+    return hash ^ (hash >> 29);
+}
+
+bool fingerprint(const std::string& path, SourceFingerprint& print) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0 || info.st_size <= 0) return false;
+
+    std::shared_ptr<MappedFile> file = MappedFile::open(path);
+    if (!file) return false;
+    print.size = file->size();
+    print.modifiedNanos = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+    print.contentHash = hashBytes(file->data(), file->size());
+    return true;
+}
+
+std::mutex& directoryMutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+std::string& directorySetting() {
+    static std::string directory = std::getenv("KOHONEN_DATASET_CACHE") ? std::getenv("KOHONEN_DATASET_CACHE") : "";
+    return directory;
+}
+}
+
+void DatasetCache::setDirectory(const std::string& directory) {
+    std::lock_guard<std::mutex> lock(directoryMutex());
+    directorySetting() = directory;
+}
+
+std::string DatasetCache::getDirectory() {
+    std::lock_guard<std::mutex> lock(directoryMutex());
+    return directorySetting();
+}
+
+Dataset DatasetCache::find(const std::vector<std::string>& sources, int maxSamples, DatasetCacheKey& key) {
+    key = DatasetCacheKey();
+    key.maxSamples = maxSamples > 0 ? maxSamples : -1;
+    std::string directory = getDirectory();
+    if (directory.empty() || sources.empty() || sources.size() > maxSources || !isLittleEndian()) {
+        return Dataset();
+    }
+
+    // The entry's name comes from where the sources are; whether it is still
+    // valid is decided by what they contain
+    std::string identity = std::to_string(key.maxSamples);
+    for (const std::string& source : sources) {
+        SourceFingerprint print;
+        if (!fingerprint(source, print)) return Dataset();
+        key.sources.push_back(print);
+
+        char resolved[PATH_MAX];
+        identity += '\n';
+        identity += realpath(source.c_str(), resolved) ? resolved : source;
+    }
+    std::ostringstream name;
+    name << directory << "/dataset-" << std::hex
+         << hashBytes(reinterpret_cast<const unsigned char*>(identity.data()), identity.size()) << ".cache";
+    key.path = name.str();
+
+    struct stat info;
+    if (stat(key.path.c_str(), &info) != 0) return Dataset();
+    std::shared_ptr<MappedFile> mapping = MappedFile::open(key.path);
+    if (!mapping) return Dataset();
+
+    DatasetCacheHeader header;
+    if (mapping->size() < sizeof(header)) {
+        std::cerr << "Ignoring truncated dataset cache: " << key.path << std::endl;
+        return Dataset();
+    }
+    std::memcpy(&header, mapping->data(), sizeof(header));
+
+    bool valid = std::memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) == 0 &&
+                 header.version == currentVersion && header.headerSize == sizeof(DatasetCacheHeader) &&
+                 header.count > 0 && header.inputSize > 0 &&
+                 header.stride == ((static_cast<uint32_t>(header.inputSize) + 15) & ~15u) &&
+                 header.fileSize <= mapping->size();
+
+    // Offset, values per sample and value size of each section. As in ModelFile,
+    // sizes are checked by division and ends by subtraction so crafted fields
+    // cannot overflow.
+    const uint64_t sections[][3] = {
+        {header.valuesOffset, header.stride, sizeof(float)},
+        {header.labelsOffset, 1, sizeof(int32_t)},
+    };
+    for (const auto& section : sections) {
+        if (!valid) break;
+        bool fits = section[1] <= header.fileSize / section[2] / header.count;
+        uint64_t bytes = fits ? header.count * section[1] * section[2] : 0;
+        valid = fits && section[0] % sectionAlignment == 0 && section[0] <= header.fileSize &&
+                bytes <= header.fileSize - section[0];
+    }
+    if (!valid) {
+        std::cerr << "Ignoring corrupt dataset cache: " << key.path << std::endl;
+        return Dataset();
+    }
+
+    bool fresh = header.maxSamples == key.maxSamples && header.sourceCount == key.sources.size();
+    for (size_t s = 0; fresh && s < key.sources.size(); ++s) {
+        const SourceFingerprint& stored = header.sources[s];
+        fresh = stored.size == key.sources[s].size && stored.modifiedNanos == key.sources[s].modifiedNanos &&
+                stored.contentHash == key.sources[s].contentHash;
+    }
+    if (!fresh) {
+        std::cout << "Dataset cache is stale, rebuilding: " << key.path << std::endl;
+        return Dataset();
+    }
+
+    std::cout << "Mapped cached dataset " << key.path << " (" << header.count << " samples)" << std::endl;
+    const unsigned char* base = mapping->data();
+    return Dataset::fromMapping(mapping, reinterpret_cast<const float*>(base + header.valuesOffset),
+                                reinterpret_cast<const int32_t*>(base + header.labelsOffset),
+                                header.count, header.inputSize, DatasetType::MNIST);
+}
+
+bool DatasetCache::store(const DatasetCacheKey& key, const Dataset& dataset) {
+    if (key.path.empty() || dataset.empty() || key.sources.size() > maxSources) return false;
+
+    DatasetCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = currentVersion;
+    header.headerSize = sizeof(DatasetCacheHeader);
+    header.count = dataset.size();
+    header.inputSize = dataset.getInputSize();
+    header.stride = static_cast<uint32_t>(dataset.getStride());
+    header.maxSamples = key.maxSamples;
+    header.sourceCount = static_cast<uint32_t>(key.sources.size());
+    for (size_t s = 0; s < key.sources.size(); ++s) {
+        header.sources[s] = key.sources[s];
+    }
+    header.valuesOffset = alignSection(sizeof(header));
+    header.labelsOffset = alignSection(header.valuesOffset + header.count * header.stride * sizeof(float));
+    header.fileSize = header.labelsOffset + header.count * sizeof(int32_t);
+
+    // Unique per process and call, so concurrent writers never share a temporary
+    static std::atomic<unsigned> sequence(0);
+    std::string directory = key.path.substr(0, key.path.rfind('/'));
+    mkdir(directory.c_str(), 0755);
+    std::string temporary = key.path + ".tmp" + std::to_string(getpid()) + "." + std::to_string(sequence++);
+
+    std::ofstream file(temporary, std::ios::binary);
+    if (!file) {
+        std::cerr << "Cannot write dataset cache in " << directory << std::endl;
+        return false;
+    }
+
+    static const char zeros[sectionAlignment] = {};
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(zeros, static_cast<std::streamsize>(header.valuesOffset - sizeof(header)));
+    if (dataset.isContiguous()) {
+        file.write(reinterpret_cast<const char*>(dataset.sample(0)),
+                   static_cast<std::streamsize>(header.count * header.stride * sizeof(float)));
+    } else {
+        for (size_t i = 0; i < dataset.size(); ++i) {
+            file.write(reinterpret_cast<const char*>(dataset.sample(i)),
+                       static_cast<std::streamsize>(header.stride * sizeof(float)));
+        }
+    }
+
+    uint64_t position = header.valuesOffset + header.count * header.stride * sizeof(float);
+    file.write(zeros, static_cast<std::streamsize>(header.labelsOffset - position));
+    for (size_t i = 0; i < dataset.size(); ++i) {
+        int32_t label = dataset.label(i);
+        file.write(reinterpret_cast<const char*>(&label), sizeof(label));
+    }
+    file.close();
+
+    if (!file.good() || std::rename(temporary.c_str(), key.path.c_str()) != 0) {
+        std::cerr << "Failed writing dataset cache: " << key.path << std::endl;
+        std::remove(temporary.c_str());
+        return false;
+    }
+
+    std::cout << "Cached dataset in " << key.path << " (" << (header.fileSize >> 10) << " KiB)" << std::endl;
+    return true;
+}
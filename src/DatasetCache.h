@@ -0,0 +1,63 @@
+#ifndef DATASETCACHE_H
+#define DATASETCACHE_H
+
+#include "Dataset.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A source file as it was when its dataset was decoded
+struct SourceFingerprint {
+    uint64_t size;
+    int64_t modifiedNanos;
+    uint64_t contentHash;
+};
+
+// On-disk layout of a cached dataset. All integers are little-endian, every
+// section starts on a 64-byte boundary and sample rows keep the Dataset
+// stride, so a mapped file is used in place.
+struct DatasetCacheHeader {
+    char magic[8];            // "KSOMDSC\0"
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t count;
+    int32_t inputSize;
+    uint32_t stride;          // Floats per sample row
+    int64_t maxSamples;       // As passed to the loader; -1 = all
+    uint32_t sourceCount;
+    uint32_t reserved;
+    SourceFingerprint sources[2];
+    uint64_t valuesOffset;    // float[count * stride]
+    uint64_t labelsOffset;    // int32[count]
+    uint64_t fileSize;
+};
+
+struct DatasetCacheKey {
+    std::string path;  // Cache file; empty when caching is off
+    std::vector<SourceFingerprint> sources;
+    int64_t maxSamples;
+};
+
+// Decoded datasets kept on disk between runs, one file per set of source paths
+// and maxSamples. An entry is only used while every source still has the size,
+// modification time and content hash it had when the entry was written; a stale
+// entry is replaced by the next store().
+class DatasetCache {
+public:
+    static const uint32_t currentVersion = 1;
+
+    // Where cache files go; empty disables caching. Defaults to the
+    // KOHONEN_DATASET_CACHE environment variable (unset = disabled).
+    static void setDirectory(const std::string& directory);
+    static std::string getDirectory();
+
+    // The cached decode of the sources, mapped read-only, or an empty Dataset
+    // on a miss. key is filled in for a following store().
+    static Dataset find(const std::vector<std::string>& sources, int maxSamples, DatasetCacheKey& key);
+    // Writes the entry for key through a temporary file and a rename, so readers
+    // see either the old entry or the new one. Does nothing if key.path is empty.
+    static bool store(const DatasetCacheKey& key, const Dataset& dataset);
+};
+
+#endif
@@ -0,0 +1,154 @@
+#include "DatasetStream.h"
+#include "DistanceKernels.h"
+#include "MNISTLoader.h"
+#include "NpyFile.h"
+#include "Telemetry.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+namespace {
+size_t limitSamples(size_t count, int maxSamples) {
+    return maxSamples > 0 && static_cast<size_t>(maxSamples) < count ? static_cast<size_t>(maxSamples) : count;
+}
+}
+
+std::shared_ptr<DatasetStream> DatasetStream::openIdx(const std::string& imagesPath, const std::string& labelsPath,
+                                                      DatasetType type, int maxSamples, size_t chunkSize,
+                                                      size_t queueDepth) {
+    DatasetCacheKey cacheKey;
+    Dataset cached = DatasetCache::find({imagesPath, labelsPath}, maxSamples, cacheKey);
+    if (!cached.empty()) return fromCache(cached, type, chunkSize, queueDepth);
+
+    std::shared_ptr<IdxFile> images, labels;
+    if (!MNISTLoader::mapData(imagesPath, labelsPath, images, labels)) return nullptr;
+
+    ByteMatrix pixels = images->matrix();
+    MutableDataset dataset(limitSamples(pixels.rows, maxSamples), static_cast<int>(pixels.cols), type);
+    Decoder decode = [images, labels, pixels](size_t begin, size_t end, MutableDataset& chunk) {
+        for (size_t i = begin; i < end; ++i) {
+            DistanceKernels::decodeU8(pixels.row(i), 255.0f, chunk.sample(i - begin), pixels.cols);
+            chunk.setLabel(i - begin, labels->data()[i]);
+        }
+    };
+    return std::shared_ptr<DatasetStream>(new DatasetStream(dataset, dataset, decode, cacheKey, chunkSize,
+                                                            queueDepth));
+}
+
+std::shared_ptr<DatasetStream> DatasetStream::openNpy(const std::string& imagesPath, const std::string& labelsPath,
+                                                      DatasetType type, int maxSamples, size_t chunkSize,
+                                                      size_t queueDepth) {
+    DatasetCacheKey cacheKey;
+    Dataset cached = DatasetCache::find({imagesPath, labelsPath}, maxSamples, cacheKey);
+    if (!cached.empty()) return fromCache(cached, type, chunkSize, queueDepth);
+
+    std::shared_ptr<NpyFile> images = NpyFile::open(imagesPath);
+    std::shared_ptr<NpyFile> labels = NpyFile::open(labelsPath);
+    if (!images || !labels) return nullptr;
+    if (images->shape().empty() || labels->shape().size() != 1 || labels->count() != images->count()) {
+        std::cerr << "Expected an image array and a 1-D label array of the same length: "
+                  << imagesPath << ", " << labelsPath << std::endl;
+        return nullptr;
+    }
+
+    float divisor = images->descr().compare(1, std::string::npos, "u1") == 0 ? 255.0f : 1.0f;
+    MutableDataset dataset(limitSamples(images->count(), maxSamples), static_cast<int>(images->rowSize()), type);
+    Decoder decode = [images, labels, divisor](size_t begin, size_t end, MutableDataset& chunk) {
+        images->readRows(begin, end, chunk.sample(0), chunk.getStride(), divisor);
+        std::vector<float> values(end - begin);
+        labels->readRows(begin, end, values.data(), 1);
+        for (size_t i = 0; i < values.size(); ++i) {
+            chunk.setLabel(i, static_cast<int>(values[i]));
+        }
+    };
+    return std::shared_ptr<DatasetStream>(new DatasetStream(dataset, dataset, decode, cacheKey, chunkSize,
+                                                            queueDepth));
+}
+
+std::shared_ptr<DatasetStream> DatasetStream::fromCache(Dataset cached, DatasetType type, size_t chunkSize,
+                                                        size_t queueDepth) {
+    cached.setType(type);
+    return std::shared_ptr<DatasetStream>(
+        new DatasetStream(cached, MutableDataset(), Decoder(), DatasetCacheKey(), chunkSize, queueDepth));
+}
+
+DatasetStream::DatasetStream(const Dataset& dataset, const MutableDataset& decoded, Decoder decode,
+                             const DatasetCacheKey& cacheKey, size_t chunkSize, size_t queueDepth)
+: dataset(dataset), decoded(decoded), decode(decode), cacheKey(cacheKey), chunkSize(std::max<size_t>(chunkSize, 1)),
+queueDepth(std::max<size_t>(queueDepth, 1)), finished(false), draining(false), stopping(false) {
+    thread = std::thread(&DatasetStream::decodeLoop, this);
+}
+
+DatasetStream::~DatasetStream() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    spaceCondition.notify_one();
+    thread.join();
+}
+
+bool DatasetStream::pop(Dataset& chunk) {
+    std::unique_lock<std::mutex> lock(mutex);
+    readyCondition.wait(lock, [this] { return !queue.empty() || finished; });
+    if (queue.empty()) return false;
+
+    chunk = queue.front();
+    queue.pop_front();
+    lock.unlock();
+    spaceCondition.notify_one();
+    return true;
+}
+
+const Dataset& DatasetStream::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!finished) {
+        draining = true;
+        spaceCondition.notify_one();
+        readyCondition.wait(lock, [this] { return finished; });
+    }
+    return dataset;
+}
+
+void DatasetStream::decodeLoop() {
+    // Only decoding counts as load time, not waiting on consumers or the cache write
+    std::chrono::steady_clock::duration decodeTime(0);
+    bool complete = true;
+    for (size_t begin = 0; begin < dataset.size(); begin += chunkSize) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            spaceCondition.wait(lock, [this] { return stopping || draining || queue.size() < queueDepth; });
+            if (stopping) {
+                complete = false;
+                break;
+            }
+        }
+
+        // Chunks are disjoint rows of the shared storage, so consumers can read
+        // earlier ones while this one is written
+        Dataset chunk = dataset.slice(begin, begin + chunkSize);
+        if (decode) {
+            MutableDataset rows = decoded.slice(begin, begin + chunkSize);
+            auto start = std::chrono::steady_clock::now();
+            decode(begin, begin + rows.size(), rows);
+            decodeTime += std::chrono::steady_clock::now() - start;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(chunk);
+        }
+        readyCondition.notify_all();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+    }
+    readyCondition.notify_all();
+    Telemetry::addPhaseTime(TelemetryPhase::DatasetLoad, decodeTime);
+
+    // Consumers already have the whole set; the write only delays destruction
+    if (complete) DatasetCache::store(cacheKey, dataset);
+}
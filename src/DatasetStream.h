@@ -0,0 +1,84 @@
+#ifndef DATASETSTREAM_H
+#define DATASETSTREAM_H
+
+#include "Dataset.h"
+#include "DatasetCache.h"
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Decodes a dataset on a background thread. The whole set is allocated up front
+// from the file headers and filled a chunk at a time; every finished chunk is
+// also handed out through a bounded queue, so training can start on the first
+// chunks while later ones are still being read from a cold cache or a network
+// filesystem. With a DatasetCache directory set, a fresh cache entry is mapped
+// instead and a completed decode is written back to the cache.
+class DatasetStream {
+public:
+    static const size_t defaultChunkSize = 4096;
+    static const size_t defaultQueueDepth = 4;
+
+    // IDX image/label pair (see MNISTLoader::mapData). Returns nullptr (and
+    // reports to std::cerr) if the files cannot be mapped or do not match.
+    static std::shared_ptr<DatasetStream> openIdx(const std::string& imagesPath, const std::string& labelsPath,
+                                                  DatasetType type = DatasetType::MNIST, int maxSamples = -1,
+                                                  size_t chunkSize = defaultChunkSize,
+                                                  size_t queueDepth = defaultQueueDepth);
+    // NPY image/label pair; uint8 pixels are scaled to [0,1] as in NpyLoader
+    static std::shared_ptr<DatasetStream> openNpy(const std::string& imagesPath, const std::string& labelsPath,
+                                                  DatasetType type = DatasetType::MNIST, int maxSamples = -1,
+                                                  size_t chunkSize = defaultChunkSize,
+                                                  size_t queueDepth = defaultQueueDepth);
+    ~DatasetStream();
+
+    DatasetStream(const DatasetStream&) = delete;
+    DatasetStream& operator=(const DatasetStream&) = delete;
+
+    // Known from the headers before anything is decoded
+    size_t size() const { return dataset.size(); }
+    int getInputSize() const { return dataset.getInputSize(); }
+    DatasetType getType() const { return dataset.getType(); }
+
+    // Next decoded chunk in file order, for a single consumer. Blocks until one
+    // is ready; returns false once every chunk has been taken.
+    bool pop(Dataset& chunk);
+    // Blocks until every sample is decoded and returns the whole set. The queue
+    // bound no longer applies from then on, so this never waits on pop().
+    const Dataset& wait();
+
+private:
+    typedef std::function<void(size_t begin, size_t end, MutableDataset& chunk)> Decoder;
+
+    // decode fills in decoded, the storage of dataset; without one the chunks of
+    // dataset are queued as they are
+    DatasetStream(const Dataset& dataset, const MutableDataset& decoded, Decoder decode,
+                  const DatasetCacheKey& cacheKey, size_t chunkSize, size_t queueDepth);
+    // Streams an already decoded set; the chunks only pass through the queue
+    static std::shared_ptr<DatasetStream> fromCache(Dataset cached, DatasetType type, size_t chunkSize,
+                                                    size_t queueDepth);
+
+    Dataset dataset;
+    MutableDataset decoded;
+    Decoder decode;
+    DatasetCacheKey cacheKey;
+    size_t chunkSize;
+    size_t queueDepth;
+
+    std::mutex mutex;
+    std::condition_variable readyCondition;
+    std::condition_variable spaceCondition;
+    std::deque<Dataset> queue;
+    bool finished;
+    bool draining;
+    bool stopping;
+    std::thread thread;
+
+    void decodeLoop();
+};
+
+#endif
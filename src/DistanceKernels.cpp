@@ -0,0 +1,805 @@
+#include "DistanceKernels.h"
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#ifdef KOHONEN_HAVE_CBLAS
+#include <cblas.h>
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define KOHONEN_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+typedef float (*SquaredL2Fn)(const float*, const float*, size_t);
+typedef int (*ArgminFn)(const float*, const float*, size_t, size_t, int, int, float&);
+typedef int (*PrunedArgminFn)(const float*, const float*, size_t, size_t, const uint32_t*, int, int, float&);
+typedef void (*BatchArgminFn)(const float* const*, size_t, const float*, size_t, const float*,
+                              size_t, int, int*, float*);
+typedef int32_t (*DotU8S8Fn)(const uint8_t*, const int8_t*, size_t);
+typedef float (*SquaredL2U8Fn)(const uint8_t*, float, const float*, size_t);
+typedef int (*ArgminU8Fn)(const uint8_t*, float, const float*, size_t, size_t, int, int, float&);
+typedef void (*BlendU8Fn)(float*, const uint8_t*, float, float, size_t);
+typedef void (*DecodeU8Fn)(const uint8_t*, float, float*, size_t);
+
+struct KernelTable {
+    KernelIsa isa;
+    SquaredL2Fn squaredL2;
+    ArgminFn argmin;
+    PrunedArgminFn prunedArgmin;
+    BatchArgminFn batchArgmin;
+    DotU8S8Fn dotU8S8;
+    SquaredL2U8Fn squaredL2U8;
+    ArgminU8Fn argminU8;
+    BlendU8Fn blendU8;
+    DecodeU8Fn decodeU8;
+};
+
+// Neurons per cache block: the block stays in L2 while every sample tile of a
+// batch is multiplied against it
+const int neuronBlock = 64;
+
+template <float (*Distance)(const float*, const float*, size_t)>
+inline int argminRows(const float* x, const float* rows, size_t stride, size_t n,
+                      int begin, int end, float& bestDistance) {
+    int bestIndex = begin;
+    float best = Distance(x, rows + begin * stride, n);
+    for (int i = begin + 1; i < end; ++i) {
+        float distance = Distance(x, rows + i * stride, n);
+        if (distance < best) {
+            best = distance;
+            bestIndex = i;
+        }
+    }
+    bestDistance = best;
+    return bestIndex;
+}
+
+template <float (*Distance)(const uint8_t*, float, const float*, size_t)>
+inline int argminRowsU8(const uint8_t* x, float scale, const float* rows, size_t stride, size_t n,
+                        int begin, int end, float& bestDistance) {
+    int bestIndex = begin;
+    float best = Distance(x, scale, rows + begin * stride, n);
+    for (int i = begin + 1; i < end; ++i) {
+        float distance = Distance(x, scale, rows + i * stride, n);
+        if (distance < best) {
+            best = distance;
+            bestIndex = i;
+        }
+    }
+    bestDistance = best;
+    return bestIndex;
+}
+
+// Partial sums are nondecreasing, so a row can be dropped as soon as one exceeds the
+// bound. Every row is summed block by block in the same order whether or not it is
+// dropped, which keeps the ranking identical to a full scan with this summation.
+template <float (*Distance)(const float*, const float*, size_t)>
+inline int argminRowsPruned(const float* x, const float* rows, size_t stride, size_t n,
+                            const uint32_t* blockOrder, int begin, int end, float& bestDistance) {
+    const size_t block = DistanceKernels::pruneBlockSize;
+    size_t numBlocks = (n + block - 1) / block;
+    int bestIndex = -1;
+    float best = bestDistance;
+
+    for (int i = begin; i < end; ++i) {
+        const float* row = rows + i * stride;
+        float sum = 0.0f;
+        for (size_t k = 0; k < numBlocks && sum <= best; ++k) {
+            size_t offset = blockOrder ? blockOrder[k] : k * block;
+            sum += Distance(x + offset, row + offset, std::min(block, n - offset));
+        }
+        // A row exactly at the initial bound still counts, so a seed row can win
+        if (sum < best || (bestIndex < 0 && sum == best)) {
+            best = sum;
+            bestIndex = i;
+        }
+    }
+
+    bestDistance = best;
+    return bestIndex;
+}
+
+// Blocked X.W^T driver. Tile computes an MR x NR block of dot products with the
+// samples and weight rows it is given. Scores are ||w||^2 - 2 x.w, i.e. the
+// squared distance minus the per-sample constant ||x||^2.
+template <int MR, int NR, void (*Tile)(const float* const*, const float* const*, size_t, float*)>
+void batchArgminTiled(const float* const* samples, size_t count, const float* rows, size_t stride,
+                      const float* rowNorms, size_t n, int numRows, int* bestIndex, float* bestScore) {
+    for (size_t s = 0; s < count; ++s) {
+        bestIndex[s] = 0;
+        bestScore[s] = std::numeric_limits<float>::max();
+    }
+
+    float dots[MR * NR];
+    const float* x[MR];
+    const float* w[NR];
+
+    for (int blockStart = 0; blockStart < numRows; blockStart += neuronBlock) {
+        int blockEnd = std::min(blockStart + neuronBlock, numRows);
+
+        for (size_t s = 0; s < count; s += MR) {
+            int mr = static_cast<int>(std::min<size_t>(MR, count - s));
+            // Short tiles repeat their last row, so each (sample, neuron) dot product
+            // goes through the same arithmetic wherever the batch was cut
+            for (int i = 0; i < MR; ++i) x[i] = samples[s + std::min(i, mr - 1)];
+
+            for (int j0 = blockStart; j0 < blockEnd; j0 += NR) {
+                int nr = std::min(NR, blockEnd - j0);
+                for (int j = 0; j < NR; ++j) w[j] = rows + (j0 + std::min(j, nr - 1)) * stride;
+
+                Tile(x, w, n, dots);
+
+                for (int i = 0; i < mr; ++i) {
+                    for (int j = 0; j < nr; ++j) {
+                        float score = rowNorms[j0 + j] - 2.0f * dots[i * NR + j];
+                        if (score < bestScore[s + i]) {
+                            bestScore[s + i] = score;
+                            bestIndex[s + i] = j0 + j;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+template <int MR, int NR>
+void tileDotsScalar(const float* const* x, const float* const* w, size_t n, float* dots) {
+    for (int i = 0; i < MR; ++i) {
+        for (int j = 0; j < NR; ++j) {
+            float sum = 0.0f;
+            for (size_t k = 0; k < n; ++k) {
+                sum += x[i][k] * w[j][k];
+            }
+            dots[i * NR + j] = sum;
+        }
+    }
+}
+
+void batchArgminScalar(const float* const* samples, size_t count, const float* rows, size_t stride,
+                       const float* rowNorms, size_t n, int numRows, int* bestIndex, float* bestScore) {
+    batchArgminTiled<4, 2, tileDotsScalar<4, 2>>(samples, count, rows, stride, rowNorms, n,
+                                                 numRows, bestIndex, bestScore);
+}
+
+int32_t dotU8S8Scalar(const uint8_t* a, const int8_t* b, size_t n) {
+    int32_t sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        sum += static_cast<int32_t>(a[i]) * b[i];
+    }
+    return sum;
+}
+
+float squaredL2Scalar(const float* a, const float* b, size_t n) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        float diff = a[i] - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+int argminScalar(const float* x, const float* rows, size_t stride, size_t n,
+                 int begin, int end, float& bestDistance) {
+    return argminRows<squaredL2Scalar>(x, rows, stride, n, begin, end, bestDistance);
+}
+
+int argminPrunedScalar(const float* x, const float* rows, size_t stride, size_t n,
+                       const uint32_t* blockOrder, int begin, int end, float& bestDistance) {
+    return argminRowsPruned<squaredL2Scalar>(x, rows, stride, n, blockOrder, begin, end, bestDistance);
+}
+
+float squaredL2U8Scalar(const uint8_t* x, float scale, const float* w, size_t n) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        float diff = x[i] * scale - w[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+int argminU8Scalar(const uint8_t* x, float scale, const float* rows, size_t stride, size_t n,
+                   int begin, int end, float& bestDistance) {
+    return argminRowsU8<squaredL2U8Scalar>(x, scale, rows, stride, n, begin, end, bestDistance);
+}
+
+void blendU8Scalar(float* row, const uint8_t* x, float scale, float rate, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        row[i] += rate * (x[i] * scale - row[i]);
+    }
+}
+
+void decodeU8Scalar(const uint8_t* x, float divisor, float* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = x[i] / divisor;
+    }
+}
+
+#ifdef KOHONEN_X86_KERNELS
+
+__attribute__((target("sse2")))
+inline float squaredL2SSE2(const float* a, const float* b, size_t n) {
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128 d0 = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+        __m128 d1 = _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4));
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(d0, d0));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(d1, d1));
+    }
+    __m128 acc = _mm_add_ps(acc0, acc1);
+    __m128 shuf = _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(2, 3, 0, 1));
+    acc = _mm_add_ps(acc, shuf);
+    shuf = _mm_movehl_ps(shuf, acc);
+    float sum = _mm_cvtss_f32(_mm_add_ss(acc, shuf));
+    for (; i < n; ++i) {
+        float diff = a[i] - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+__attribute__((target("sse2")))
+int argminSSE2(const float* x, const float* rows, size_t stride, size_t n,
+               int begin, int end, float& bestDistance) {
+    return argminRows<squaredL2SSE2>(x, rows, stride, n, begin, end, bestDistance);
+}
+
+__attribute__((target("sse2")))
+int argminPrunedSSE2(const float* x, const float* rows, size_t stride, size_t n,
+                     const uint32_t* blockOrder, int begin, int end, float& bestDistance) {
+    return argminRowsPruned<squaredL2SSE2>(x, rows, stride, n, blockOrder, begin, end, bestDistance);
+}
+
+__attribute__((target("avx")))
+inline float horizontalSum(__m256 v) {
+    __m128 lo = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+    lo = _mm_add_ss(lo, _mm_shuffle_ps(lo, lo, 1));
+    return _mm_cvtss_f32(lo);
+}
+
+__attribute__((target("avx512f")))
+inline float horizontalSum(__m512 v) {
+    alignas(64) float lanes[16];
+    _mm512_store_ps(lanes, v);
+    __m256 half = _mm256_add_ps(_mm256_load_ps(lanes), _mm256_load_ps(lanes + 8));
+    return horizontalSum(half);
+}
+
+__attribute__((target("avx2,fma")))
+inline float squaredL2AVX2(const float* a, const float* b, size_t n) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps();
+    __m256 acc3 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+        __m256 d2 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16));
+        __m256 d3 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24));
+        acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+        acc2 = _mm256_fmadd_ps(d2, d2, acc2);
+        acc3 = _mm256_fmadd_ps(d3, d3, acc3);
+    }
+    for (; i + 8 <= n; i += 8) {
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        acc0 = _mm256_fmadd_ps(d, d, acc0);
+    }
+    __m256 acc = _mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3));
+    float sum = horizontalSum(acc);
+    for (; i < n; ++i) {
+        float diff = a[i] - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+__attribute__((target("avx2,fma")))
+int argminAVX2(const float* x, const float* rows, size_t stride, size_t n,
+               int begin, int end, float& bestDistance) {
+    return argminRows<squaredL2AVX2>(x, rows, stride, n, begin, end, bestDistance);
+}
+
+__attribute__((target("avx2,fma")))
+int argminPrunedAVX2(const float* x, const float* rows, size_t stride, size_t n,
+                     const uint32_t* blockOrder, int begin, int end, float& bestDistance) {
+    return argminRowsPruned<squaredL2AVX2>(x, rows, stride, n, blockOrder, begin, end, bestDistance);
+}
+
+// 4 samples x 2 neurons: 8 accumulators plus 6 operands fit the 16 ymm registers
+__attribute__((target("avx2,fma")))
+void tileDotsAVX2(const float* const* x, const float* const* w, size_t n, float* dots) {
+    __m256 acc[4][2];
+    for (int i = 0; i < 4; ++i) {
+        acc[i][0] = _mm256_setzero_ps();
+        acc[i][1] = _mm256_setzero_ps();
+    }
+
+    size_t k = 0;
+    for (; k + 8 <= n; k += 8) {
+        __m256 w0 = _mm256_loadu_ps(w[0] + k);
+        __m256 w1 = _mm256_loadu_ps(w[1] + k);
+        for (int i = 0; i < 4; ++i) {
+            __m256 xi = _mm256_loadu_ps(x[i] + k);
+            acc[i][0] = _mm256_fmadd_ps(xi, w0, acc[i][0]);
+            acc[i][1] = _mm256_fmadd_ps(xi, w1, acc[i][1]);
+        }
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 2; ++j) {
+            float sum = horizontalSum(acc[i][j]);
+            for (size_t t = k; t < n; ++t) {
+                sum += x[i][t] * w[j][t];
+            }
+            dots[i * 2 + j] = sum;
+        }
+    }
+}
+
+__attribute__((target("avx2,fma")))
+void batchArgminAVX2(const float* const* samples, size_t count, const float* rows, size_t stride,
+                     const float* rowNorms, size_t n, int numRows, int* bestIndex, float* bestScore) {
+    batchArgminTiled<4, 2, tileDotsAVX2>(samples, count, rows, stride, rowNorms, n,
+                                         numRows, bestIndex, bestScore);
+}
+
+// Bytes are widened to int32 and converted, 16 per iteration in two halves
+__attribute__((target("avx2,fma")))
+inline float squaredL2U8AVX2(const uint8_t* x, float scale, const float* w, size_t n) {
+    __m256 s = _mm256_set1_ps(scale);
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+        __m256 x0 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes)), s);
+        __m256 x1 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8))), s);
+        __m256 d0 = _mm256_sub_ps(x0, _mm256_loadu_ps(w + i));
+        __m256 d1 = _mm256_sub_ps(x1, _mm256_loadu_ps(w + i + 8));
+        acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+    }
+    float sum = horizontalSum(_mm256_add_ps(acc0, acc1));
+    for (; i < n; ++i) {
+        float diff = x[i] * scale - w[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+__attribute__((target("avx2,fma")))
+int argminU8AVX2(const uint8_t* x, float scale, const float* rows, size_t stride, size_t n,
+                 int begin, int end, float& bestDistance) {
+    return argminRowsU8<squaredL2U8AVX2>(x, scale, rows, stride, n, begin, end, bestDistance);
+}
+
+__attribute__((target("avx2,fma")))
+void blendU8AVX2(float* row, const uint8_t* x, float scale, float rate, size_t n) {
+    __m256 s = _mm256_set1_ps(scale);
+    __m256 r = _mm256_set1_ps(rate);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(x + i));
+        __m256 xv = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes)), s);
+        __m256 wv = _mm256_loadu_ps(row + i);
+        _mm256_storeu_ps(row + i, _mm256_fmadd_ps(r, _mm256_sub_ps(xv, wv), wv));
+    }
+    for (; i < n; ++i) {
+        row[i] += rate * (x[i] * scale - row[i]);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+void decodeU8AVX2(const uint8_t* x, float divisor, float* out, size_t n) {
+    __m256 d = _mm256_set1_ps(divisor);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(x + i));
+        _mm256_storeu_ps(out + i, _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes)), d));
+    }
+    for (; i < n; ++i) {
+        out[i] = x[i] / divisor;
+    }
+}
+
+// u8 x s8 products widened to 16 bits, so unlike maddubs nothing can saturate
+__attribute__((target("avx2")))
+int32_t dotU8S8AVX2(const uint8_t* a, const int8_t* b, size_t n) {
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i a0 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+        __m256i b0 = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+        __m256i a1 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i + 16)));
+        __m256i b1 = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i + 16)));
+        acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(a0, b0));
+        acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(a1, b1));
+    }
+    __m256i acc = _mm256_add_epi32(acc0, acc1);
+    __m128i lo = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    lo = _mm_add_epi32(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(1, 0, 3, 2)));
+    lo = _mm_add_epi32(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+    int32_t sum = _mm_cvtsi128_si32(lo);
+    for (; i < n; ++i) {
+        sum += static_cast<int32_t>(a[i]) * b[i];
+    }
+    return sum;
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+int32_t dotU8S8VNNI(const uint8_t* a, const int8_t* b, size_t n) {
+    __m512i acc = _mm512_setzero_si512();
+    for (size_t i = 0; i < n; i += 64) {
+        __mmask64 mask = n - i >= 64 ? ~static_cast<__mmask64>(0)
+                                     : (static_cast<__mmask64>(1) << (n - i)) - 1;
+        __m512i av = _mm512_maskz_loadu_epi8(mask, a + i);
+        __m512i bv = _mm512_maskz_loadu_epi8(mask, b + i);
+        acc = _mm512_dpbusd_epi32(acc, av, bv);
+    }
+    alignas(64) int32_t lanes[16];
+    _mm512_store_si512(reinterpret_cast<__m512i*>(lanes), acc);
+    int32_t sum = 0;
+    for (int lane = 0; lane < 16; ++lane) {
+        sum += lanes[lane];
+    }
+    return sum;
+}
+
+__attribute__((target("avx512f")))
+inline float squaredL2AVX512(const float* a, const float* b, size_t n) {
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+        acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm512_fmadd_ps(d1, d1, acc1);
+    }
+    for (; i + 16 <= n; i += 16) {
+        __m512 d = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        acc0 = _mm512_fmadd_ps(d, d, acc0);
+    }
+    if (i < n) {
+        __mmask16 mask = static_cast<__mmask16>((1u << (n - i)) - 1);
+        __m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i));
+        acc1 = _mm512_fmadd_ps(d, d, acc1);
+    }
+    return horizontalSum(_mm512_add_ps(acc0, acc1));
+}
+
+__attribute__((target("avx512f")))
+int argminAVX512(const float* x, const float* rows, size_t stride, size_t n,
+                 int begin, int end, float& bestDistance) {
+    return argminRows<squaredL2AVX512>(x, rows, stride, n, begin, end, bestDistance);
+}
+
+__attribute__((target("avx512f")))
+int argminPrunedAVX512(const float* x, const float* rows, size_t stride, size_t n,
+                       const uint32_t* blockOrder, int begin, int end, float& bestDistance) {
+    return argminRowsPruned<squaredL2AVX512>(x, rows, stride, n, blockOrder, begin, end, bestDistance);
+}
+
+// 16 bytes widened to floats. The zero-masking forms avoid GCC's
+// -Wmaybe-uninitialized false positive on the unmasked conversions.
+__attribute__((target("avx512f")))
+inline __m512 bytesToFloatsAVX512(const uint8_t* x) {
+    __m512i widened = _mm512_maskz_cvtepu8_epi32(0xFFFF, _mm_loadu_si128(reinterpret_cast<const __m128i*>(x)));
+    return _mm512_maskz_cvtepi32_ps(0xFFFF, widened);
+}
+
+__attribute__((target("avx512f")))
+inline float squaredL2U8AVX512(const uint8_t* x, float scale, const float* w, size_t n) {
+    __m512 s = _mm512_set1_ps(scale);
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512 x0 = bytesToFloatsAVX512(x + i);
+        __m512 x1 = bytesToFloatsAVX512(x + i + 16);
+        __m512 d0 = _mm512_fmsub_ps(x0, s, _mm512_loadu_ps(w + i));
+        __m512 d1 = _mm512_fmsub_ps(x1, s, _mm512_loadu_ps(w + i + 16));
+        acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm512_fmadd_ps(d1, d1, acc1);
+    }
+    for (; i + 16 <= n; i += 16) {
+        __m512 xv = bytesToFloatsAVX512(x + i);
+        __m512 d = _mm512_fmsub_ps(xv, s, _mm512_loadu_ps(w + i));
+        acc0 = _mm512_fmadd_ps(d, d, acc0);
+    }
+    float sum = horizontalSum(_mm512_add_ps(acc0, acc1));
+    for (; i < n; ++i) {
+        float diff = x[i] * scale - w[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+__attribute__((target("avx512f")))
+int argminU8AVX512(const uint8_t* x, float scale, const float* rows, size_t stride, size_t n,
+                   int begin, int end, float& bestDistance) {
+    return argminRowsU8<squaredL2U8AVX512>(x, scale, rows, stride, n, begin, end, bestDistance);
+}
+
+__attribute__((target("avx512f")))
+void blendU8AVX512(float* row, const uint8_t* x, float scale, float rate, size_t n) {
+    __m512 s = _mm512_set1_ps(scale);
+    __m512 r = _mm512_set1_ps(rate);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 xv = _mm512_mul_ps(bytesToFloatsAVX512(x + i), s);
+        __m512 wv = _mm512_loadu_ps(row + i);
+        _mm512_storeu_ps(row + i, _mm512_fmadd_ps(r, _mm512_sub_ps(xv, wv), wv));
+    }
+    for (; i < n; ++i) {
+        row[i] += rate * (x[i] * scale - row[i]);
+    }
+}
+
+__attribute__((target("avx512f")))
+void decodeU8AVX512(const uint8_t* x, float divisor, float* out, size_t n) {
+    __m512 d = _mm512_set1_ps(divisor);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        _mm512_storeu_ps(out + i, _mm512_div_ps(bytesToFloatsAVX512(x + i), d));
+    }
+    for (; i < n; ++i) {
+        out[i] = x[i] / divisor;
+    }
+}
+
+// 4 samples x 4 neurons: 16 accumulators plus 8 operands out of 32 zmm registers
+__attribute__((target("avx512f")))
+void tileDotsAVX512(const float* const* x, const float* const* w, size_t n, float* dots) {
+    __m512 acc[4][4];
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            acc[i][j] = _mm512_setzero_ps();
+        }
+    }
+
+    for (size_t k = 0; k < n; k += 16) {
+        __mmask16 mask = n - k >= 16 ? static_cast<__mmask16>(0xFFFF)
+                                     : static_cast<__mmask16>((1u << (n - k)) - 1);
+        __m512 wv[4];
+        for (int j = 0; j < 4; ++j) {
+            wv[j] = _mm512_maskz_loadu_ps(mask, w[j] + k);
+        }
+        for (int i = 0; i < 4; ++i) {
+            __m512 xi = _mm512_maskz_loadu_ps(mask, x[i] + k);
+            for (int j = 0; j < 4; ++j) {
+                acc[i][j] = _mm512_fmadd_ps(xi, wv[j], acc[i][j]);
+            }
+        }
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            dots[i * 4 + j] = horizontalSum(acc[i][j]);
+        }
+    }
+}
+
+__attribute__((target("avx512f")))
+void batchArgminAVX512(const float* const* samples, size_t count, const float* rows, size_t stride,
+                       const float* rowNorms, size_t n, int numRows, int* bestIndex, float* bestScore) {
+    batchArgminTiled<4, 4, tileDotsAVX512>(samples, count, rows, stride, rowNorms, n,
+                                           numRows, bestIndex, bestScore);
+}
+
+#endif
+
+bool vnniSupported() {
+#ifdef KOHONEN_X86_KERNELS
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512vnni") && __builtin_cpu_supports("avx512bw");
+#else
+    return false;
+#endif
+}
+
+bool isaSupported(KernelIsa isa) {
+#ifdef KOHONEN_X86_KERNELS
+    __builtin_cpu_init();
+    switch (isa) {
+        case KernelIsa::Scalar: return true;
+        case KernelIsa::SSE2: return __builtin_cpu_supports("sse2");
+        case KernelIsa::AVX2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case KernelIsa::AVX512: return __builtin_cpu_supports("avx512f");
+    }
+    return false;
+#else
+    return isa == KernelIsa::Scalar;
+#endif
+}
+
+KernelTable makeTable(KernelIsa isa) {
+    switch (isa) {
+#ifdef KOHONEN_X86_KERNELS
+        case KernelIsa::AVX512:
+            return {isa, squaredL2AVX512, argminAVX512, argminPrunedAVX512, batchArgminAVX512,
+                    vnniSupported() ? dotU8S8VNNI : dotU8S8AVX2,
+                    squaredL2U8AVX512, argminU8AVX512, blendU8AVX512, decodeU8AVX512};
+        case KernelIsa::AVX2:
+            return {isa, squaredL2AVX2, argminAVX2, argminPrunedAVX2, batchArgminAVX2, dotU8S8AVX2,
+                    squaredL2U8AVX2, argminU8AVX2, blendU8AVX2, decodeU8AVX2};
+        case KernelIsa::SSE2:
+            return {isa, squaredL2SSE2, argminSSE2, argminPrunedSSE2, batchArgminScalar, dotU8S8Scalar,
+                    squaredL2U8Scalar, argminU8Scalar, blendU8Scalar, decodeU8Scalar};
+#endif
+        default:
+            return {KernelIsa::Scalar, squaredL2Scalar, argminScalar, argminPrunedScalar,
+                    batchArgminScalar, dotU8S8Scalar, squaredL2U8Scalar, argminU8Scalar, blendU8Scalar,
+                    decodeU8Scalar};
+    }
+}
+
+KernelTable& table() {
+    static KernelTable kernels = makeTable(DistanceKernels::detectIsa());
+    return kernels;
+}
+
+#ifdef KOHONEN_HAVE_CBLAS
+void batchArgminBlas(const float* const* samples, size_t count, const float* rows, size_t stride,
+                     const float* rowNorms, size_t n, int numRows, int* bestIndex, float* bestScore) {
+    // Tiled over neurons as well, so the dot buffer stays 256 KB whatever the map
+    // size; both buffers are reused across calls on the same thread
+    const size_t sampleBlock = 64;
+    const int rowBlock = 1024;
+    thread_local std::vector<float> packed;
+    thread_local std::vector<float> dots;
+    packed.resize(sampleBlock * n);
+    dots.resize(sampleBlock * static_cast<size_t>(std::min(rowBlock, numRows)));
+
+    for (size_t s0 = 0; s0 < count; s0 += sampleBlock) {
+        size_t m = std::min(sampleBlock, count - s0);
+        for (size_t i = 0; i < m; ++i) {
+            std::copy(samples[s0 + i], samples[s0 + i] + n, packed.begin() + i * n);
+            bestIndex[s0 + i] = 0;
+            bestScore[s0 + i] = std::numeric_limits<float>::max();
+        }
+
+        for (int r0 = 0; r0 < numRows; r0 += rowBlock) {
+            int rowCount = std::min(rowBlock, numRows - r0);
+            cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans,
+                        static_cast<int>(m), rowCount, static_cast<int>(n),
+                        1.0f, packed.data(), static_cast<int>(n), rows + r0 * stride, static_cast<int>(stride),
+                        0.0f, dots.data(), rowCount);
+
+            for (size_t i = 0; i < m; ++i) {
+                const float* row = dots.data() + i * rowCount;
+                for (int j = 0; j < rowCount; ++j) {
+                    float score = rowNorms[r0 + j] - 2.0f * row[j];
+                    if (score < bestScore[s0 + i]) {
+                        bestScore[s0 + i] = score;
+                        bestIndex[s0 + i] = r0 + j;
+                    }
+                }
+            }
+        }
+    }
+}
+#endif
+
+}
+
+float DistanceKernels::squaredL2(const float* a, const float* b, size_t n) {
+    return table().squaredL2(a, b, n);
+}
+
+int DistanceKernels::argminSquaredL2(const float* x, const float* rows, size_t stride, size_t n,
+                                     int begin, int end, float& bestDistance) {
+    return table().argmin(x, rows, stride, n, begin, end, bestDistance);
+}
+
+int DistanceKernels::argminSquaredL2Pruned(const float* x, const float* rows, size_t stride, size_t n,
+                                           const uint32_t* blockOrder, int begin, int end,
+                                           float& bestDistance) {
+    return table().prunedArgmin(x, rows, stride, n, blockOrder, begin, end, bestDistance);
+}
+
+void DistanceKernels::argminSquaredL2Batch(const float* const* samples, size_t count,
+                                           const float* rows, size_t stride, const float* rowNorms,
+                                           size_t n, int numRows, int* bestIndex, float* bestDistance) {
+    if (count == 0 || numRows <= 0) return;
+
+#ifdef KOHONEN_HAVE_CBLAS
+    batchArgminBlas(samples, count, rows, stride, rowNorms, n, numRows, bestIndex, bestDistance);
+#else
+    table().batchArgmin(samples, count, rows, stride, rowNorms, n, numRows, bestIndex, bestDistance);
+#endif
+
+    // The expanded form loses precision to cancellation; report the exact distance of the winner
+    for (size_t s = 0; s < count; ++s) {
+        bestDistance[s] = table().squaredL2(samples[s], rows + bestIndex[s] * stride, n);
+    }
+}
+
+void DistanceKernels::squaredNorms(const float* rows, size_t stride, size_t n, int numRows, float* norms) {
+    for (int r = 0; r < numRows; ++r) {
+        const float* row = rows + r * stride;
+        float sum = 0.0f;
+        for (size_t i = 0; i < n; ++i) {
+            sum += row[i] * row[i];
+        }
+        norms[r] = sum;
+    }
+}
+
+float DistanceKernels::squaredL2U8(const uint8_t* x, float scale, const float* w, size_t n) {
+    return table().squaredL2U8(x, scale, w, n);
+}
+
+int DistanceKernels::argminSquaredL2U8(const uint8_t* x, float scale, const float* rows, size_t stride,
+                                       size_t n, int begin, int end, float& bestDistance) {
+    return table().argminU8(x, scale, rows, stride, n, begin, end, bestDistance);
+}
+
+void DistanceKernels::blendU8(float* row, const uint8_t* x, float scale, float rate, size_t n) {
+    table().blendU8(row, x, scale, rate, n);
+}
+
+void DistanceKernels::decodeU8(const uint8_t* x, float divisor, float* out, size_t n) {
+    table().decodeU8(x, divisor, out, n);
+}
+
+int32_t DistanceKernels::dotU8S8(const uint8_t* a, const int8_t* b, size_t n) {
+    return table().dotU8S8(a, b, n);
+}
+
+int DistanceKernels::argminQuantized(const uint8_t* x, const int8_t* rows, size_t stride, size_t n,
+                                     const float* scales, const float* norms, int numRows, float& bestScore) {
+    DotU8S8Fn dot = table().dotU8S8;
+    int bestIndex = 0;
+    bestScore = std::numeric_limits<float>::max();
+    for (int r = 0; r < numRows; ++r) {
+        float score = norms[r] - 2.0f * scales[r] * static_cast<float>(dot(x, rows + r * stride, n));
+        if (score < bestScore) {
+            bestScore = score;
+            bestIndex = r;
+        }
+    }
+    return bestIndex;
+}
+
+bool DistanceKernels::hasVnni() {
+    return table().isa == KernelIsa::AVX512 && vnniSupported();
+}
+
+KernelIsa DistanceKernels::activeIsa() {
+    return table().isa;
+}
+
+KernelIsa DistanceKernels::detectIsa() {
+    const KernelIsa candidates[] = {KernelIsa::AVX512, KernelIsa::AVX2, KernelIsa::SSE2};
+    for (KernelIsa isa : candidates) {
+        if (isaSupported(isa)) return isa;
+    }
+    return KernelIsa::Scalar;
+}
+
+bool DistanceKernels::setIsa(KernelIsa isa) {
+    if (!isaSupported(isa)) return false;
+    table() = makeTable(isa);
+    return true;
+}
+
+const char* DistanceKernels::isaName(KernelIsa isa) {
+    switch (isa) {
+        case KernelIsa::Scalar: return "scalar";
+        case KernelIsa::SSE2: return "SSE2";
+        case KernelIsa::AVX2: return "AVX2";
+        case KernelIsa::AVX512: return "AVX-512";
+    }
+    return "unknown";
+}
@@ -0,0 +1,71 @@
+#ifndef DISTANCEKERNELS_H
+#define DISTANCEKERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+enum class KernelIsa {
+    Scalar,
+    SSE2,
+    AVX2,
+    AVX512
+};
+
+// Vectorized distance kernels. The best implementation the CPU supports is
+// picked once via CPUID the first time any kernel is used.
+class DistanceKernels {
+public:
+    static float squaredL2(const float* a, const float* b, size_t n);
+
+    // Index in [begin, end) of the row nearest to x (squared L2, lowest index on ties).
+    // Rows are `stride` floats apart and only the first n columns are compared.
+    static int argminSquaredL2(const float* x, const float* rows, size_t stride, size_t n,
+                               int begin, int end, float& bestDistance);
+
+    // Exact nearest row with partial-distance pruning. Distances are accumulated
+    // pruneBlockSize floats at a time, visiting blocks in blockOrder (block start
+    // offsets; null = natural order), and a row is abandoned once its partial sum
+    // passes the best so far. bestDistance is an upper bound on entry (a seed row's
+    // distance from this same function tightens it early); returns -1 if no row in
+    // [begin, end) is within it, lowest index on ties.
+    static const size_t pruneBlockSize = 64;
+    static int argminSquaredL2Pruned(const float* x, const float* rows, size_t stride, size_t n,
+                                     const uint32_t* blockOrder, int begin, int end, float& bestDistance);
+
+    // Nearest row for each of `count` samples, computed as ||x||^2 - 2 x.W^T + ||w||^2
+    // with a cache-blocked, register-tiled matrix multiply (or cblas_sgemm when built
+    // with KOHONEN_HAVE_CBLAS). rowNorms holds ||w||^2 per row; bestDistance receives
+    // the exact squared distance to the winner.
+    static void argminSquaredL2Batch(const float* const* samples, size_t count,
+                                     const float* rows, size_t stride, const float* rowNorms,
+                                     size_t n, int numRows, int* bestIndex, float* bestDistance);
+    static void squaredNorms(const float* rows, size_t stride, size_t n, int numRows, float* norms);
+
+    // Distance and update for 8-bit samples, normalized on the fly as x * scale
+    // (1/255 for pixels) so no float copy of the sample is needed
+    static float squaredL2U8(const uint8_t* x, float scale, const float* w, size_t n);
+    static int argminSquaredL2U8(const uint8_t* x, float scale, const float* rows, size_t stride, size_t n,
+                                 int begin, int end, float& bestDistance);
+    // row += rate * (x * scale - row)
+    static void blendU8(float* row, const uint8_t* x, float scale, float rate, size_t n);
+    // out = x / divisor, correctly rounded like the scalar division the loaders used
+    static void decodeU8(const uint8_t* x, float divisor, float* out, size_t n);
+
+    // Exact integer dot product of 8-bit inputs with int8 weights
+    // (AVX-512 VNNI or AVX2 widening multiply-add where available)
+    static int32_t dotU8S8(const uint8_t* a, const int8_t* b, size_t n);
+
+    // Nearest quantized row: score_j = norms[j] - 2 * scales[j] * dot(x, q_j).
+    // Returns the lowest-scoring row (lowest index on ties) and its score.
+    static int argminQuantized(const uint8_t* x, const int8_t* rows, size_t stride, size_t n,
+                               const float* scales, const float* norms, int numRows, float& bestScore);
+    static bool hasVnni();
+
+    static KernelIsa activeIsa();
+    static KernelIsa detectIsa();
+    // Forces a specific implementation (e.g. for benchmarking); fails if the CPU lacks it
+    static bool setIsa(KernelIsa isa);
+    static const char* isaName(KernelIsa isa);
+};
+
+#endif
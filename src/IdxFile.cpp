@@ -0,0 +1,55 @@
+#include "IdxFile.h"
+#include <iostream>
+
+namespace {
+const uint8_t unsignedByteType = 0x08;
+
+uint32_t readBigEndian(const uint8_t* bytes) {
+    return (static_cast<uint32_t>(bytes[0]) << 24) | (static_cast<uint32_t>(bytes[1]) << 16) |
+           (static_cast<uint32_t>(bytes[2]) << 8) | bytes[3];
+}
+}
+
+std::shared_ptr<IdxFile> IdxFile::open(const std::string& filename) {
+    std::shared_ptr<MappedFile> file = MappedFile::open(filename);
+    if (!file) return nullptr;
+
+    // Magic: two zero bytes, the element type, then the number of dimensions
+    const uint8_t* bytes = file->data();
+    size_t size = file->size();
+    if (size < 4 || bytes[0] != 0 || bytes[1] != 0 || bytes[3] == 0) {
+        std::cerr << "Not an IDX file: " << filename << std::endl;
+        return nullptr;
+    }
+    if (bytes[2] != unsignedByteType) {
+        std::cerr << "Unsupported IDX element type 0x" << std::hex << static_cast<int>(bytes[2]) << std::dec
+                  << " (only unsigned bytes): " << filename << std::endl;
+        return nullptr;
+    }
+
+    size_t numDims = bytes[3];
+    size_t headerSize = 4 + 4 * numDims;
+    if (size < headerSize) {
+        std::cerr << "Truncated IDX header: " << filename << std::endl;
+        return nullptr;
+    }
+
+    std::vector<uint32_t> dims(numDims);
+    size_t itemBytes = 1;
+    for (size_t d = 0; d < numDims; ++d) {
+        dims[d] = readBigEndian(bytes + 4 + 4 * d);
+        if (d > 0) itemBytes *= dims[d];
+    }
+
+    if (itemBytes == 0 || (size - headerSize) / itemBytes < dims[0]) {
+        std::cerr << "IDX payload is shorter than its header declares: " << filename << std::endl;
+        return nullptr;
+    }
+
+    return std::shared_ptr<IdxFile>(new IdxFile(file, bytes + headerSize, dims, itemBytes));
+}
+
+IdxFile::IdxFile(std::shared_ptr<MappedFile> file, const uint8_t* payload, std::vector<uint32_t> dims,
+                 size_t itemBytes)
+: file(file), payload(payload), dims(dims), itemBytes(itemBytes) {
+}
@@ -0,0 +1,47 @@
+#ifndef IDXFILE_H
+#define IDXFILE_H
+
+#include "MappedFile.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Rows of 8-bit samples stored back to back. Does not own the bytes.
+struct ByteMatrix {
+    const uint8_t* data;
+    size_t rows;
+    size_t cols;
+
+    const uint8_t* row(size_t index) const { return data + index * cols; }
+    ByteMatrix slice(size_t begin, size_t end) const { return {row(begin), end - begin, cols}; }
+};
+
+// IDX file (the format MNIST is distributed in) mapped read-only. The big-endian
+// header is validated against the file size once; the unsigned-byte payload is
+// then read in place, so opening costs the same whatever the sample count.
+class IdxFile {
+public:
+    // Returns nullptr (and reports to std::cerr) unless the file is a complete
+    // unsigned-byte IDX file
+    static std::shared_ptr<IdxFile> open(const std::string& filename);
+
+    const std::vector<uint32_t>& dimensions() const { return dims; }
+    size_t count() const { return dims[0]; }
+    // Bytes per item: the product of all dimensions but the first
+    size_t itemSize() const { return itemBytes; }
+    const uint8_t* data() const { return payload; }
+    // All items as a count x itemSize matrix, valid while this object lives
+    ByteMatrix matrix() const { return {payload, count(), itemBytes}; }
+
+private:
+    IdxFile(std::shared_ptr<MappedFile> file, const uint8_t* payload, std::vector<uint32_t> dims, size_t itemBytes);
+
+    std::shared_ptr<MappedFile> file;
+    const uint8_t* payload;
+    std::vector<uint32_t> dims;
+    size_t itemBytes;
+};
+
+#endif
@@ -0,0 +1,344 @@
+#include "InferenceServer.h"
+#include "KohonenNetwork.h"
+#include "IdxFile.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+// How often blocked reads and accepts look at the stop flag
+const int pollMillis = 200;
+// Unsent answers a client may have before its frames stop being read
+const size_t maxPendingReplyBytes = 1 << 20;
+
+// Reads exactly `size` bytes; false on end of input, error or stop
+bool readFrame(int fd, uint8_t* out, size_t size, const std::atomic<bool>& stopping) {
+    size_t received = 0;
+    while (received < size) {
+        pollfd request = {fd, POLLIN, 0};
+        int ready = poll(&request, 1, pollMillis);
+        if (stopping.load()) return false;
+        if (ready < 0 && errno != EINTR) return false;
+        if (ready <= 0) continue;
+
+        ssize_t count = read(fd, out + received, size - received);
+        if (count == 0) return false;
+        if (count < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            return false;
+        }
+        received += static_cast<size_t>(count);
+    }
+    return true;
+}
+
+bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t count = write(fd, data, size);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += count;
+        size -= static_cast<size_t>(count);
+    }
+    return true;
+}
+
+double percentile(std::vector<float>& values, double fraction) {
+    if (values.empty()) return 0.0;
+    size_t rank = std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()));
+    std::nth_element(values.begin(), values.begin() + rank, values.end());
+    return values[rank];
+}
+}
+
+InferenceServer::Connection::~Connection() {
+    if (ownsFds) {
+        close(inputFd);
+        if (outputFd != inputFd) close(outputFd);
+    }
+}
+
+InferenceServer::InferenceServer(const KohonenNetwork& network, const InferenceServerOptions& options)
+: network(network), options(options), frameSize(static_cast<size_t>(network.getInputSize())),
+stopping(false), inFlight(0), batcherExit(false), totalRequests(0), totalBatches(0),
+windowStart(std::chrono::steady_clock::now()) {
+
+    this->options.maxBatch = std::max<size_t>(this->options.maxBatch, 1);
+    batcher = std::thread(&InferenceServer::batchLoop, this);
+}
+
+InferenceServer::~InferenceServer() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        batcherExit = true;
+    }
+    queueCondition.notify_all();
+    batcher.join();
+}
+
+bool InferenceServer::serveStream(int inputFd, int outputFd) {
+    std::shared_ptr<Connection> connection(new Connection(inputFd, outputFd, false));
+    readLoop(connection);
+    waitUntilDrained();
+    reportStats(true);
+    return true;
+}
+
+bool InferenceServer::serveUnixSocket(const std::string& socketPath) {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path too long: " << socketPath << std::endl;
+        return false;
+    }
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        std::cerr << "Cannot create socket: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    unlink(socketPath.c_str());
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listenFd, 64) != 0) {
+        std::cerr << "Cannot listen on " << socketPath << ": " << std::strerror(errno) << std::endl;
+        close(listenFd);
+        return false;
+    }
+
+    std::cout << "Serving " << frameSize << "-byte frames on " << socketPath << std::endl;
+
+    struct Reader {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> finished;
+    };
+    std::vector<Reader> readers;
+
+    while (!stopping.load()) {
+        pollfd request = {listenFd, POLLIN, 0};
+        if (poll(&request, 1, pollMillis) <= 0) continue;
+
+        int clientFd = accept(listenFd, nullptr, nullptr);
+        if (clientFd < 0) continue;
+
+        // Reap readers of clients that have gone away
+        for (size_t i = 0; i < readers.size();) {
+            if (readers[i].finished->load()) {
+                readers[i].thread.join();
+                readers[i] = std::move(readers.back());
+                readers.pop_back();
+            } else {
+                ++i;
+            }
+        }
+
+        std::shared_ptr<Connection> connection(new Connection(clientFd, clientFd, true));
+        std::shared_ptr<std::atomic<bool>> finished(new std::atomic<bool>(false));
+        readers.push_back({std::thread([this, connection, finished] {
+            readLoop(connection);
+            finished->store(true);
+        }), finished});
+    }
+
+    for (Reader& reader : readers) {
+        reader.thread.join();
+    }
+    waitUntilDrained();
+    close(listenFd);
+    unlink(socketPath.c_str());
+    reportStats(true);
+    return true;
+}
+
+void InferenceServer::readLoop(std::shared_ptr<Connection> connection) {
+    std::thread writer(&InferenceServer::writeLoop, this, std::ref(*connection));
+
+    while (true) {
+        Request request;
+        request.pixels.resize(frameSize);
+        if (!readFrame(connection->inputFd, request.pixels.data(), frameSize, stopping)) break;
+
+        {
+            // Backpressure from a client that is not reading its answers
+            std::unique_lock<std::mutex> lock(connection->mutex);
+            while (!connection->failed && !stopping.load() &&
+                   connection->pending.size() >= maxPendingReplyBytes) {
+                connection->condition.wait_for(lock, std::chrono::milliseconds(pollMillis));
+            }
+            if (connection->failed) break;
+            connection->outstanding++;
+        }
+
+        request.connection = connection;
+        request.arrival = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            queue.push_back(std::move(request));
+        }
+        queueCondition.notify_one();
+    }
+
+    // The writer leaves once every queued frame has been answered and sent
+    {
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        connection->inputDone = true;
+    }
+    connection->condition.notify_all();
+    writer.join();
+}
+
+void InferenceServer::writeLoop(Connection& connection) {
+    std::unique_lock<std::mutex> lock(connection.mutex);
+    std::vector<char> sending;
+    while (true) {
+        connection.condition.wait(lock, [&connection] {
+            return !connection.pending.empty() || (connection.inputDone && connection.outstanding == 0);
+        });
+        if (connection.pending.empty()) return;
+
+        sending.swap(connection.pending);
+        lock.unlock();
+        connection.condition.notify_all();
+        bool written = writeAll(connection.outputFd, sending.data(), sending.size());
+        sending.clear();
+        lock.lock();
+
+        if (!written) {
+            connection.failed = true;
+            connection.pending.clear();
+            connection.condition.notify_all();
+            return;
+        }
+    }
+}
+
+void InferenceServer::batchLoop() {
+    std::unique_lock<std::mutex> lock(queueMutex);
+    std::vector<Request> batch;
+
+    while (true) {
+        queueCondition.wait(lock, [this] { return batcherExit || !queue.empty(); });
+        if (queue.empty()) return;
+
+        // Wait for the batch to fill, but never past the oldest request's latency budget
+        auto deadline = queue.front().arrival + std::chrono::microseconds(options.maxDelayMicros);
+        queueCondition.wait_until(lock, deadline, [this] {
+            return batcherExit || queue.size() >= options.maxBatch;
+        });
+
+        size_t count = std::min(queue.size(), options.maxBatch);
+        batch.clear();
+        for (size_t i = 0; i < count; ++i) {
+            batch.push_back(std::move(queue.front()));
+            queue.pop_front();
+        }
+        inFlight += count;
+
+        lock.unlock();
+        scoreBatch(batch);
+        batch.clear();  // Drops connection references before the drain check
+        lock.lock();
+
+        inFlight -= count;
+        drainedCondition.notify_all();
+    }
+}
+
+void InferenceServer::scoreBatch(std::vector<Request>& batch) {
+    // Frames are scored as the 8-bit samples they arrived as
+    size_t count = batch.size();
+    std::vector<uint8_t> frames(count * frameSize);
+    for (size_t i = 0; i < count; ++i) {
+        std::copy(batch[i].pixels.begin(), batch[i].pixels.end(), frames.begin() + i * frameSize);
+    }
+
+    std::vector<ClassificationResult> results(count);
+    network.classifyBatch(ByteMatrix{frames.data(), count, frameSize}, results.data());
+
+    // Answers are grouped per client, kept in request order and handed to the
+    // clients' writers
+    std::map<Connection*, std::vector<char>> replies;
+    for (size_t i = 0; i < count; ++i) {
+        int32_t label = results[i].predictedLabel;
+        float confidence = results[i].confidence;
+        std::vector<char>& reply = replies[batch[i].connection.get()];
+        const char* labelBytes = reinterpret_cast<const char*>(&label);
+        const char* confidenceBytes = reinterpret_cast<const char*>(&confidence);
+        reply.insert(reply.end(), labelBytes, labelBytes + sizeof(label));
+        reply.insert(reply.end(), confidenceBytes, confidenceBytes + sizeof(confidence));
+    }
+    for (auto& reply : replies) {
+        Connection& connection = *reply.first;
+        {
+            std::lock_guard<std::mutex> lock(connection.mutex);
+            if (!connection.failed) {
+                connection.pending.insert(connection.pending.end(), reply.second.begin(), reply.second.end());
+            }
+            connection.outstanding -= reply.second.size() / (sizeof(int32_t) + sizeof(float));
+        }
+        connection.condition.notify_all();
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    bool report;
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        // Throughput counts from the first request of the window, not from idle time before it
+        if (latencies.empty()) {
+            windowStart = batch.front().arrival;
+        }
+        for (const Request& request : batch) {
+            latencies.push_back(std::chrono::duration<float, std::micro>(now - request.arrival).count());
+        }
+        totalRequests += count;
+        totalBatches++;
+        report = now - windowStart >= std::chrono::seconds(options.reportIntervalSeconds);
+    }
+    if (report) {
+        reportStats(false);
+    }
+}
+
+void InferenceServer::waitUntilDrained() {
+    std::unique_lock<std::mutex> lock(queueMutex);
+    drainedCondition.wait(lock, [this] { return queue.empty() && inFlight == 0; });
+}
+
+InferenceStats InferenceServer::getStats() const {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    std::vector<float> window = latencies;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - windowStart).count();
+
+    InferenceStats stats;
+    stats.requests = totalRequests;
+    stats.batches = totalBatches;
+    stats.requestsPerSecond = seconds > 0.0 ? window.size() / seconds : 0.0;
+    stats.p50Micros = percentile(window, 0.50);
+    stats.p99Micros = percentile(window, 0.99);
+    return stats;
+}
+
+void InferenceServer::reportStats(bool final) {
+    InferenceStats stats = getStats();
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        if (latencies.empty() && !final) return;
+        latencies.clear();
+        windowStart = std::chrono::steady_clock::now();
+    }
+
+    std::cerr << (final ? "Served " : "Serving: ") << stats.requests << " requests in "
+              << stats.batches << " batches - " << stats.requestsPerSecond << " req/s, p50 "
+              << stats.p50Micros << " us, p99 " << stats.p99Micros << " us" << std::endl;
+}
@@ -0,0 +1,108 @@
+#ifndef INFERENCESERVER_H
+#define INFERENCESERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class KohonenNetwork;
+
+struct InferenceServerOptions {
+    size_t maxBatch = 64;         // Requests scored together at most
+    int maxDelayMicros = 1000;    // Longest a request waits for its batch to fill
+    int reportIntervalSeconds = 10;
+};
+
+struct InferenceStats {
+    uint64_t requests;
+    uint64_t batches;
+    double requestsPerSecond;
+    double p50Micros;
+    double p99Micros;
+};
+
+// Headless scoring loop. Clients send frames of inputSize raw 8-bit pixels and
+// get back, per frame and in order, an int32 predicted label followed by a
+// float32 confidence (distance to the BMU), both little-endian. Requests from
+// all clients are coalesced into micro-batches and scored with
+// KohonenNetwork::classifyBatch. Each client's answers are written by its own
+// writer thread, so a client that reads slowly only delays itself; once its
+// unsent answers pile up, its frames stop being read until it catches up.
+class InferenceServer {
+public:
+    InferenceServer(const KohonenNetwork& network, const InferenceServerOptions& options = InferenceServerOptions());
+    ~InferenceServer();
+
+    InferenceServer(const InferenceServer&) = delete;
+    InferenceServer& operator=(const InferenceServer&) = delete;
+
+    // Accepts connections on a UNIX domain socket until stop()
+    bool serveUnixSocket(const std::string& socketPath);
+    // Serves one framed stream (e.g. stdin/stdout) until end of input or stop()
+    bool serveStream(int inputFd, int outputFd);
+    // Safe to call from a signal handler
+    void stop() { stopping.store(true); }
+
+    // Latency is measured from a frame being read to its answer being handed to
+    // the client's writer
+    InferenceStats getStats() const;
+
+private:
+    struct Connection {
+        Connection(int inputFd, int outputFd, bool ownsFds)
+        : inputFd(inputFd), outputFd(outputFd), ownsFds(ownsFds) {}
+
+        int inputFd, outputFd;
+        bool ownsFds;
+
+        // Shared by the reader, the batcher and the writer of this client
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::vector<char> pending;   // Answers not yet written
+        size_t outstanding = 0;      // Frames queued but not yet answered
+        bool inputDone = false;
+        bool failed = false;         // The client stopped taking answers
+        ~Connection();
+    };
+
+    struct Request {
+        std::shared_ptr<Connection> connection;
+        std::vector<uint8_t> pixels;
+        std::chrono::steady_clock::time_point arrival;
+    };
+
+    const KohonenNetwork& network;
+    InferenceServerOptions options;
+    size_t frameSize;
+
+    std::atomic<bool> stopping;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    std::condition_variable drainedCondition;
+    std::deque<Request> queue;
+    size_t inFlight;
+    bool batcherExit;
+    std::thread batcher;
+
+    mutable std::mutex statsMutex;
+    std::vector<float> latencies;  // Microseconds since the last report
+    uint64_t totalRequests;
+    uint64_t totalBatches;
+    std::chrono::steady_clock::time_point windowStart;
+
+    void readLoop(std::shared_ptr<Connection> connection);
+    void writeLoop(Connection& connection);
+    void batchLoop();
+    void scoreBatch(std::vector<Request>& batch);
+    void waitUntilDrained();
+    void reportStats(bool final);
+};
+
+#endif
@@ -1,119 +1,1005 @@
 #include "KohonenNetwork.h"
+#include "DatasetStream.h"
+#include "DistanceKernels.h"
+#include "Telemetry.h"
 #include <cmath>
 #include <algorithm>
+#include <chrono>
 #include <iostream>
-#include <map>
 #include <limits>
+#include <numeric>
+#include <sstream>
+
+namespace {
+// Below this many weights a single-sample BMU scan is cheaper than waking the pool
+const size_t parallelSearchMinWeights = 1 << 18;
+const size_t minNeuronsPerChunk = 256;
+const size_t minSamplesPerChunk = 32;
+// 8-bit samples decoded to float at a time when scoring from a ByteMatrix
+const size_t decodeBlockSamples = 64;
+// 8-bit samples decoded at a time for the labeling pass after byte training
+const size_t labelingChunkSamples = 4096;
+// Relative slack when comparing distances from different kernels as ties
+const float recallTieTolerance = 1e-5f;
+
+struct BestMatch {
+    float distance;
+    int index;
+
+    bool betterThan(const BestMatch& other) const {
+        return distance < other.distance || (distance == other.distance && index < other.index);
+    }
+};
+
+const char* trainingModeName(TrainingMode mode) {
+    switch (mode) {
+        case TrainingMode::Batch: return "batch";
+        case TrainingMode::Hogwild: return "hogwild";
+        default: return "online";
+    }
+}
+}
 
 KohonenNetwork::KohonenNetwork(int w, int h, int d, int inputSize)
-: width(w), height(h), depth(d), inputSize(inputSize),
+: KohonenNetwork(w, h, d, inputSize, true) {
+}
+
+KohonenNetwork::KohonenNetwork(int w, int h, int d, int inputSize, bool allocate)
+: width(w), height(h), depth(d), inputSize(inputSize), classCount(0),
 rng(std::random_device{}()), currentEpoch(0),
-currentDatasetType(DatasetType::MNIST) {
+currentDatasetType(DatasetType::MNIST), trainingMode(TrainingMode::Online),
+schedule{0.5f, 0.0f, 3.0f}, pool(new ThreadPool()), shuffleBlockSize(0), checkpointInterval(0),
+earlyStopThreshold(0.0f), earlyStopPatience(0), epochErrorSum(0.0), epochErrorCount(0),
+inferencePrecision(InferencePrecision::Float32), quantizedStride(0),
+approximateRescanInterval(0), approximateRecall(-1.0f), prunedSearch(false),
+searchIndexEnabled(false) {
+
+    stencil.radius = -1.0f;
 
-    neurons.reserve(width * height * depth);
+    numNeurons = width * height * depth;
+    weightStride = (static_cast<size_t>(inputSize) + 15) & ~static_cast<size_t>(15);
+
+    // A network loaded from a model file maps these instead
+    if (allocate) {
+        weights.assign(numNeurons * weightStride, 0.0f);
+        prototypeImages.assign(static_cast<size_t>(numNeurons) * inputSize, 0.0f);
+    }
+    weightData = weights.data();
+    prototypeData = prototypeImages.data();
+
+    positions.reserve(numNeurons * 3);
+    colors.assign(numNeurons * 3, 0.5f);
+    activationCounts.assign(numNeurons, 0);
+    dominantClasses.assign(numNeurons, -1);
 
     for (int z = 0; z < depth; ++z) {
         for (int y = 0; y < height; ++y) {
             for (int x = 0; x < width; ++x) {
-                float posX = (x - width/2.0f) * 2.0f / width;
-                float posY = (y - height/2.0f) * 2.0f / height;
-                float posZ = (z - depth/2.0f) * 2.0f / depth;
-
-                neurons.emplace_back(inputSize, posX, posY, posZ);
+                positions.push_back((x - width/2.0f) * 2.0f / width);
+                positions.push_back((y - height/2.0f) * 2.0f / height);
+                positions.push_back((z - depth/2.0f) * 2.0f / depth);
             }
         }
     }
 }
 
+NeuronView KohonenNetwork::getNeuron(int index) const {
+    NeuronView view;
+    view.weights = getWeights(index);
+    view.x = positions[index * 3];
+    view.y = positions[index * 3 + 1];
+    view.z = positions[index * 3 + 2];
+    view.activationCount = activationCounts[index];
+    view.dominantClass = dominantClasses[index];
+    view.hitCount = hitCounts.empty() ? 0 : hitCounts[index];
+    view.color = &colors[index * 3];
+    view.prototypeImage = prototypeData + static_cast<size_t>(index) * inputSize;
+    return view;
+}
+
+void KohonenNetwork::setApproximateSearch(bool enabled, int rescanInterval) {
+    approximateRescanInterval = enabled ? std::max(rescanInterval, 1) : 0;
+}
+
+void KohonenNetwork::attachMappedModel(std::shared_ptr<MappedFile> file, const float* mappedWeights,
+                                       const float* mappedPrototypes) {
+    searchIndex.clear();
+    weights.clear();
+    weights.shrink_to_fit();
+    prototypeImages.clear();
+    prototypeImages.shrink_to_fit();
+
+    mappedModel = file;
+    weightData = mappedWeights;
+    prototypeData = mappedPrototypes;
+}
+
+void KohonenNetwork::ownWeights() {
+    // Every weight update starts here, so nothing derived from the old weights
+    // outlives them: the index would point into freed or stale rows
+    if (!searchIndex.empty()) {
+        searchIndex.clear();
+    }
+    if (!quantizedWeights.empty()) {
+        quantizedWeights.clear();
+        inferencePrecision = InferencePrecision::Float32;
+        std::cout << "Weights changed: discarded the frozen int8 copy, back to float inference" << std::endl;
+    }
+    if (!mappedModel) return;
+
+    weights.assign(weightData, weightData + numNeurons * weightStride);
+    prototypeImages.assign(prototypeData, prototypeData + static_cast<size_t>(numNeurons) * inputSize);
+    weightData = weights.data();
+    prototypeData = prototypeImages.data();
+    mappedModel.reset();
+}
+
+void KohonenNetwork::setSearchIndex(bool enabled) {
+    searchIndexEnabled = enabled;
+    if (!enabled) {
+        searchIndex.clear();
+    } else if (!sampleAssignments.empty() || mappedModel) {
+        buildSearchIndex();
+    }
+}
+
+void KohonenNetwork::buildSearchIndex() {
+    searchIndex.build(weightData, weightStride, inputSize, numNeurons);
+
+    MetricTreeStats stats = searchIndex.getStats();
+    if (stats.bruteForce) {
+        std::cout << "Search index skipped: " << numNeurons << " neurons are scanned faster linearly" << std::endl;
+    } else {
+        std::cout << "Built VP-tree over " << numNeurons << " neurons in " << stats.buildSeconds
+                  << "s (" << stats.nodes << " nodes, depth " << stats.depth << ")" << std::endl;
+    }
+}
+
+void KohonenNetwork::setNumThreads(int numThreads) {
+    pool.reset(new ThreadPool(numThreads));
+}
+
+NeuronView NeuronRange::iterator::operator*() const {
+    return network->getNeuron(index);
+}
+
 void KohonenNetwork::initialize() {
     std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+    ownWeights();
 
-    for (auto& neuron : neurons) {
-        for (auto& weight : neuron.weights) {
-            weight = dist(rng);
+    for (int n = 0; n < numNeurons; ++n) {
+        float* row = weightRow(n);
+        for (int i = 0; i < inputSize; ++i) {
+            row[i] = dist(rng);
         }
     }
 
-    std::cout << "Network initialized with " << neurons.size() << " neurons" << std::endl;
+    std::cout << "Network initialized with " << numNeurons << " neurons ("
+              << DistanceKernels::isaName(DistanceKernels::activeIsa()) << " kernels)" << std::endl;
 }
 
-void KohonenNetwork::train(const std::vector<MNISTImage>& dataset, int epochs) {
+TrainingHistory KohonenNetwork::train(const Dataset& dataset, int epochs) {
     std::cout << "Starting training for " << epochs << " epochs..." << std::endl;
 
-    if (!dataset.empty()) {
-        currentDatasetType = dataset[0].type;
+    ownWeights();
+    seedBmus.clear();
+    approximateRecall = -1.0f;
+    history.quantizationErrors.clear();
+    runEpochs(dataset, 0, epochs);
+    return history;
+}
+
+void KohonenNetwork::setEarlyStopping(float minRelativeImprovement, int patience) {
+    earlyStopThreshold = minRelativeImprovement;
+    earlyStopPatience = patience;
+}
+
+bool KohonenNetwork::converged() const {
+    if (earlyStopPatience <= 0) return false;
+
+    // Epochs since the last one that beat the best QE by the required margin
+    const std::vector<float>& errors = history.quantizationErrors;
+    float best = std::numeric_limits<float>::max();
+    int stalled = 0;
+    for (float error : errors) {
+        if (error < best * (1.0f - earlyStopThreshold)) {
+            stalled = 0;
+        } else {
+            stalled++;
+        }
+        best = std::min(best, error);
+    }
+    return stalled >= earlyStopPatience;
+}
+
+bool KohonenNetwork::resumeTraining(const Dataset& dataset, const std::string& checkpointFile) {
+    TrainingCheckpoint checkpoint;
+    if (!checkpoint.load(checkpointFile)) return false;
+
+    // Batch epochs visit samples in file order and save no shuffled order
+    size_t weightCount = static_cast<size_t>(numNeurons) * inputSize;
+    bool shuffled = static_cast<TrainingMode>(checkpoint.trainingMode) != TrainingMode::Batch;
+    if (checkpoint.width != width || checkpoint.height != height || checkpoint.depth != depth ||
+        checkpoint.inputSize != inputSize || checkpoint.weights.size() != weightCount ||
+        checkpoint.activationCounts.size() != static_cast<size_t>(numNeurons) ||
+        (shuffled && checkpoint.sampleOrder.size() != dataset.size())) {
+        std::cerr << "Checkpoint " << checkpointFile << " does not match this network and dataset" << std::endl;
+        return false;
+    }
+
+    std::istringstream rngState(checkpoint.rngState);
+    rngState >> rng;
+    if (rngState.fail()) {
+        std::cerr << "Corrupt random state in checkpoint: " << checkpointFile << std::endl;
+        return false;
+    }
+
+    ownWeights();
+    for (int n = 0; n < numNeurons; ++n) {
+        const float* row = checkpoint.weights.data() + static_cast<size_t>(n) * inputSize;
+        std::copy(row, row + inputSize, weightRow(n));
+    }
+    activationCounts.assign(checkpoint.activationCounts.begin(), checkpoint.activationCounts.end());
+    sampleOrder = checkpoint.sampleOrder;
+    seedBmus.assign(checkpoint.seedBmus.begin(), checkpoint.seedBmus.end());
+    trainingMode = static_cast<TrainingMode>(checkpoint.trainingMode);
+    schedule = {checkpoint.initialLearningRate, checkpoint.initialRadius, checkpoint.decayRate};
+    shuffleBlockSize = static_cast<size_t>(checkpoint.shuffleBlockSize);
+    approximateRescanInterval = checkpoint.approximateRescanInterval;
+    approximateRecall = checkpoint.approximateRecall;
+    history.quantizationErrors = checkpoint.quantizationErrors;
+
+    std::cout << "Resuming training from " << checkpointFile << " at epoch " << checkpoint.epoch + 1
+              << "/" << checkpoint.totalEpochs << std::endl;
+    runEpochs(dataset, checkpoint.epoch + 1, checkpoint.totalEpochs);
+    return true;
+}
+
+void KohonenNetwork::runEpochs(const Dataset& dataset, int firstEpoch, int epochs) {
+    pruneBlockOrder.clear();
+    if (prunedSearch) {
+        updatePruneBlockOrder(dataset);
+    }
+
+    runSchedule(dataset.size(), dataset.getType(), firstEpoch, epochs, true,
+                [&](int epoch, float learningRate, float neighborhoodRadius) {
+        trainEpoch(dataset, epoch, learningRate, neighborhoodRadius);
+    });
+
+    if (searchIndexEnabled) {
+        buildSearchIndex();
+    }
+    labelNeurons(dataset);
+    finishTraining();
+}
+
+void KohonenNetwork::trainEpoch(const Dataset& dataset, int epoch, float learningRate, float neighborhoodRadius) {
+    if (trainingMode == TrainingMode::Batch) {
+        trainBatchEpoch(dataset, neighborhoodRadius);
+    } else if (trainingMode == TrainingMode::Hogwild) {
+        shuffleSampleOrder(dataset.size());
+        trainHogwildEpoch(dataset, learningRate, neighborhoodRadius);
+    } else {
+        shuffleSampleOrder(dataset.size());
+
+        if (approximateRescanInterval > 0) {
+            trainOnlineEpochApproximate(dataset, epoch, learningRate, neighborhoodRadius);
+        } else if (prunedSearch) {
+            trainOnlineEpochPruned(dataset, learningRate, neighborhoodRadius);
+        } else {
+            for (uint32_t index : sampleOrder) {
+                trainStep(dataset.sample(index), learningRate, neighborhoodRadius);
+            }
+        }
+    }
+}
+
+TrainingHistory KohonenNetwork::train(DatasetStream& stream, int epochs) {
+    // Batch and Hogwild epochs, pruning and approximate search need every sample
+    // from the start; they still overlap loading with whatever ran before this
+    if (trainingMode != TrainingMode::Online || approximateRescanInterval > 0 || prunedSearch) {
+        return train(stream.wait(), epochs);
+    }
+
+    std::cout << "Starting training for " << epochs << " epochs while the dataset loads..." << std::endl;
+    ownWeights();
+    seedBmus.clear();
+    approximateRecall = -1.0f;
+    history.quantizationErrors.clear();
+    pruneBlockOrder.clear();
+
+    runSchedule(stream.size(), stream.getType(), 0, epochs, true,
+                [&](int epoch, float learningRate, float neighborhoodRadius) {
+        if (epoch > 0) {
+            trainEpoch(stream.wait(), epoch, learningRate, neighborhoodRadius);
+            return;
+        }
+
+        // First epoch: chunks in the order they are decoded, each shuffled. The
+        // visiting order is kept as the epoch's sample order, so later epochs and
+        // checkpoints continue from it as from a shuffled epoch.
+        sampleOrder.clear();
+        Dataset chunk;
+        while (stream.pop(chunk)) {
+            size_t first = sampleOrder.size();
+            sampleOrder.resize(first + chunk.size());
+            std::iota(sampleOrder.begin() + first, sampleOrder.end(), 0u);
+            std::shuffle(sampleOrder.begin() + first, sampleOrder.end(), rng);
+            for (size_t i = first; i < sampleOrder.size(); ++i) {
+                trainStep(chunk.sample(sampleOrder[i]), learningRate, neighborhoodRadius);
+                sampleOrder[i] += static_cast<uint32_t>(first);
+            }
+        }
+    });
+
+    const Dataset& dataset = stream.wait();
+    if (searchIndexEnabled) {
+        buildSearchIndex();
+    }
+    labelNeurons(dataset);
+    finishTraining();
+    return history;
+}
+
+TrainingHistory KohonenNetwork::train(const ByteMatrix& images, const uint8_t* labels, DatasetType type,
+                                      int epochs) {
+    std::cout << "Starting training for " << epochs << " epochs on " << images.rows << " 8-bit samples..."
+              << std::endl;
+    if (images.rows == 0) return history;
+    if (images.cols != static_cast<size_t>(inputSize)) {
+        std::cerr << "Samples have " << images.cols << " pixels, the network expects " << inputSize << std::endl;
+        return history;
+    }
+
+    // Everything but plain online epochs needs the samples as floats
+    if (trainingMode != TrainingMode::Online || approximateRescanInterval > 0 || prunedSearch ||
+        checkpointWriter) {
+        std::cout << "The configured mode, search or checkpoints need float samples; decoding all "
+                  << images.rows << " samples" << std::endl;
+        MutableDataset dataset(images.rows, inputSize, type);
+        for (size_t i = 0; i < images.rows; ++i) {
+            DistanceKernels::decodeU8(images.row(i), 255.0f, dataset.sample(i), images.cols);
+            dataset.setLabel(i, labels[i]);
+        }
+        return train(dataset, epochs);
+    }
+
+    ownWeights();
+    seedBmus.clear();
+    approximateRecall = -1.0f;
+    history.quantizationErrors.clear();
+    pruneBlockOrder.clear();
+
+    runSchedule(images.rows, type, 0, epochs, false, [&](int, float learningRate, float neighborhoodRadius) {
+        shuffleSampleOrder(images.rows);
+        for (uint32_t index : sampleOrder) {
+            trainStep(images.row(index), learningRate, neighborhoodRadius);
+        }
+    });
+
+    if (searchIndexEnabled) {
+        buildSearchIndex();
+    }
+
+    // Labels and prototypes from float copies of one chunk at a time
+    {
+        ScopedTimer timer(TelemetryPhase::Labeling);
+        LabelingPass pass = beginLabeling(images.rows);
+        MutableDataset buffer(std::min(labelingChunkSamples, images.rows), inputSize, type);
+        for (size_t begin = 0; begin < images.rows; begin += buffer.size()) {
+            MutableDataset chunk = buffer.slice(0, std::min(buffer.size(), images.rows - begin));
+            for (size_t i = 0; i < chunk.size(); ++i) {
+                DistanceKernels::decodeU8(images.row(begin + i), 255.0f, chunk.sample(i), images.cols);
+                chunk.setLabel(i, labels[begin + i]);
+            }
+            labelChunk(chunk, begin, pass);
+        }
+        finishLabeling(pass);
+    }
+    finishTraining();
+    return history;
+}
+
+TrainingHistory KohonenNetwork::trainChunked(size_t count, size_t chunkSize, const ChunkReader& readChunk,
+                                             DatasetType type, int epochs) {
+    std::cout << "Starting chunked training for " << epochs << " epochs..." << std::endl;
+    if (count == 0 || chunkSize == 0) return history;
+
+    ownWeights();
+    seedBmus.clear();
+    approximateRecall = -1.0f;
+    history.quantizationErrors.clear();
+    pruneBlockOrder.clear();
+    if (trainingMode != TrainingMode::Online || approximateRescanInterval > 0 || prunedSearch) {
+        std::cout << "Chunked training runs plain online epochs; the configured mode and search are not used"
+                  << std::endl;
+    }
+
+    size_t numChunks = (count + chunkSize - 1) / chunkSize;
+    std::vector<uint32_t> chunkOrder(numChunks);
+    std::iota(chunkOrder.begin(), chunkOrder.end(), 0u);
+
+    runSchedule(count, type, 0, epochs, false, [&](int, float learningRate, float neighborhoodRadius) {
+        std::shuffle(chunkOrder.begin(), chunkOrder.end(), rng);
+        for (uint32_t chunk : chunkOrder) {
+            size_t begin = static_cast<size_t>(chunk) * chunkSize;
+            Dataset samples = readChunk(begin, std::min(begin + chunkSize, count));
+
+            sampleOrder.resize(samples.size());
+            std::iota(sampleOrder.begin(), sampleOrder.end(), 0u);
+            std::shuffle(sampleOrder.begin(), sampleOrder.end(), rng);
+            for (uint32_t index : sampleOrder) {
+                trainStep(samples.sample(index), learningRate, neighborhoodRadius);
+            }
+        }
+    });
+
+    if (searchIndexEnabled) {
+        buildSearchIndex();
+    }
+
+    // One more pass, in order, for the labels and prototypes
+    {
+        ScopedTimer timer(TelemetryPhase::Labeling);
+        LabelingPass pass = beginLabeling(count);
+        for (size_t begin = 0; begin < count; begin += chunkSize) {
+            labelChunk(readChunk(begin, std::min(begin + chunkSize, count)), begin, pass);
+        }
+        finishLabeling(pass);
+    }
+    finishTraining();
+    return history;
+}
+
+template <typename TrainEpoch>
+void KohonenNetwork::runSchedule(size_t count, DatasetType type, int firstEpoch, int epochs, bool checkpoints,
+                                 const TrainEpoch& trainEpoch) {
+    inferencePrecision = InferencePrecision::Float32;
+    quantizedWeights.clear();
+    searchIndex.clear();
+
+    if (count > 0) {
+        currentDatasetType = type;
         std::string datasetName = (currentDatasetType == DatasetType::MNIST) ? "MNIST" : "Fashion-MNIST";
-        std::cout << "Training on " << datasetName << " dataset" << std::endl;
+        std::cout << "Training on " << datasetName << " dataset ("
+                  << trainingModeName(trainingMode) << " mode)" << std::endl;
     }
 
-    for (int epoch = 0; epoch < epochs; ++epoch) {
+    history.stoppedEarly = false;
+    history.epochsRun = firstEpoch;
+    float initialRadius = schedule.initialRadius > 0.0f ? schedule.initialRadius
+                        : std::max(width, std::max(height, depth)) / 2.0f;
+
+    for (int epoch = firstEpoch; epoch < epochs; ++epoch) {
         currentEpoch = epoch;
+        epochErrorSum = 0.0;
+        epochErrorCount = 0;
+        auto epochStart = std::chrono::steady_clock::now();
 
-        float learningRate = 0.5f * std::exp(-epoch / (epochs / 3.0f));
+        float decay = std::exp(-epoch / (epochs / schedule.decayRate));
+        float learningRate = schedule.initialLearningRate * decay;
+        float neighborhoodRadius = initialRadius * decay;
 
-        float neighborhoodRadius = std::max(width, std::max(height, depth)) / 2.0f *
-        std::exp(-epoch / (epochs / 3.0f));
+        trainEpoch(epoch, learningRate, neighborhoodRadius);
 
-        auto shuffledDataset = dataset;
-        std::shuffle(shuffledDataset.begin(), shuffledDataset.end(), rng);
+        float quantizationError = epochErrorCount > 0 ? static_cast<float>(epochErrorSum / epochErrorCount) : 0.0f;
+        history.quantizationErrors.push_back(quantizationError);
+        history.epochsRun = epoch + 1;
 
-        for (const auto& sample : shuffledDataset) {
-            trainStep(sample, learningRate, neighborhoodRadius);
-        }
+        double epochSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - epochStart).count();
+        Telemetry::countSamples(count);
+        Telemetry::recordEpoch({epoch, epochSeconds, count, quantizationError});
+        bool stop = converged();
 
-        if (epoch % 10 == 0 || epoch == epochs - 1) {
+        if (epoch % 10 == 0 || epoch == epochs - 1 || stop) {
             std::cout << "Epoch " << epoch << "/" << epochs
             << " - LR: " << learningRate
-            << " - Radius: " << neighborhoodRadius << std::endl;
+            << " - Radius: " << neighborhoodRadius
+            << " - QE: " << quantizationError
+            << " - " << count / std::max(epochSeconds, 1e-9) << " samples/s";
+            if (approximateRecall >= 0.0f) {
+                std::cout << " - BMU recall: " << approximateRecall * 100 << "%";
+            }
+            std::cout << std::endl;
         }
+
+        if (stop) {
+            std::cout << "Stopping early: QE improved less than " << earlyStopThreshold * 100
+                      << "% over the last " << earlyStopPatience << " epochs" << std::endl;
+            history.stoppedEarly = true;
+            break;
+        }
+
+        if (checkpoints && checkpointWriter && (epoch + 1) % checkpointInterval == 0 && epoch != epochs - 1) {
+            writeCheckpoint(epoch, epochs, learningRate, neighborhoodRadius);
+        }
+    }
+
+    if (checkpointWriter) {
+        checkpointWriter->flush();
     }
+}
 
-    classifyNeurons(dataset);
-    findPrototypeImages(dataset);
+void KohonenNetwork::finishTraining() {
     updateColors();
 
-    std::cout << "Training completed!" << std::endl;
+    std::cout << "Training completed! Quantization error: "
+              << Metrics::calculateQuantizationError(sampleAssignments) << std::endl;
+}
+
+void KohonenNetwork::setCheckpointing(const std::string& filename, int interval) {
+    checkpointWriter.reset();
+    checkpointInterval = interval;
+    if (interval > 0 && !filename.empty()) {
+        checkpointWriter.reset(new CheckpointWriter(filename));
+    }
+}
+
+void KohonenNetwork::writeCheckpoint(int epoch, int epochs, float learningRate, float neighborhoodRadius) {
+    // Only the in-memory copy happens here; the file is written by the writer thread
+    TrainingCheckpoint& checkpoint = checkpointWriter->acquire();
+    checkpoint.width = width;
+    checkpoint.height = height;
+    checkpoint.depth = depth;
+    checkpoint.inputSize = inputSize;
+    checkpoint.epoch = epoch;
+    checkpoint.totalEpochs = epochs;
+    checkpoint.learningRate = learningRate;
+    checkpoint.neighborhoodRadius = neighborhoodRadius;
+    checkpoint.initialLearningRate = schedule.initialLearningRate;
+    checkpoint.initialRadius = schedule.initialRadius;
+    checkpoint.decayRate = schedule.decayRate;
+    checkpoint.trainingMode = static_cast<int32_t>(trainingMode);
+    checkpoint.datasetType = static_cast<int32_t>(currentDatasetType);
+    checkpoint.shuffleBlockSize = shuffleBlockSize;
+    checkpoint.approximateRescanInterval = approximateRescanInterval;
+    checkpoint.approximateRecall = approximateRecall;
+
+    std::ostringstream rngState;
+    rngState << rng;
+    checkpoint.rngState = rngState.str();
+
+    checkpoint.weights.resize(static_cast<size_t>(numNeurons) * inputSize);
+    for (int n = 0; n < numNeurons; ++n) {
+        const float* row = getWeights(n);
+        std::copy(row, row + inputSize, checkpoint.weights.begin() + static_cast<size_t>(n) * inputSize);
+    }
+    checkpoint.activationCounts.assign(activationCounts.begin(), activationCounts.end());
+    checkpoint.sampleOrder = sampleOrder;
+    checkpoint.seedBmus.assign(seedBmus.begin(), seedBmus.end());
+    checkpoint.quantizationErrors = history.quantizationErrors;
+
+    checkpointWriter->submit(checkpoint);
+}
+
+void KohonenNetwork::shuffleSampleOrder(size_t count) {
+    ScopedTimer timer(TelemetryPhase::Shuffle);
+    if (shuffleBlockSize <= 1) {
+        // Reshuffling the previous permutation is as random as starting over
+        if (sampleOrder.size() != count) {
+            sampleOrder.resize(count);
+            std::iota(sampleOrder.begin(), sampleOrder.end(), 0u);
+        }
+        std::shuffle(sampleOrder.begin(), sampleOrder.end(), rng);
+        return;
+    }
+
+    // Visit contiguous blocks of samples in random order, shuffled within each block
+    size_t numBlocks = (count + shuffleBlockSize - 1) / shuffleBlockSize;
+    std::vector<uint32_t> blocks(numBlocks);
+    std::iota(blocks.begin(), blocks.end(), 0u);
+    std::shuffle(blocks.begin(), blocks.end(), rng);
+
+    sampleOrder.resize(count);
+    size_t position = 0;
+    for (uint32_t block : blocks) {
+        size_t begin = block * shuffleBlockSize;
+        size_t end = std::min(begin + shuffleBlockSize, count);
+        auto segment = sampleOrder.begin() + position;
+        std::iota(segment, segment + (end - begin), static_cast<uint32_t>(begin));
+        std::shuffle(segment, segment + (end - begin), rng);
+        position += end - begin;
+    }
+}
+
+template <typename Blend>
+void KohonenNetwork::updateNeighbors(int bmuIndex, float learningRate, const NeighborhoodStencil& neighborhood,
+                                     const Blend& blend) {
+    ScopedTimer timer(TelemetryPhase::NeighborhoodUpdate);
+    uint64_t updated = 0;
+
+    int bx, by, bz;
+    getXYZ(bmuIndex, bx, by, bz);
+
+    for (const StencilOffset& offset : neighborhood.offsets) {
+        int x = bx + offset.dx;
+        int y = by + offset.dy;
+        int z = bz + offset.dz;
+        if (x < 0 || x >= width || y < 0 || y >= height || z < 0 || z >= depth) continue;
+
+        blend(weightRow(get3DIndex(x, y, z)), learningRate * offset.influence);
+        updated++;
+    }
+
+    Telemetry::countNeuronUpdates(updated);
 }
 
 void KohonenNetwork::trainStep(const MNISTImage& input, float learningRate, float neighborhoodRadius) {
-    int bmuIndex = findBestMatchingUnit(input.pixels);
-    auto neighbors = getNeighbors(bmuIndex, neighborhoodRadius);
+    trainStep(input.pixels.data(), learningRate, neighborhoodRadius);
+}
 
-    for (int neighborIndex : neighbors) {
-        float spatialDistance = calculateSpatialDistance(bmuIndex, neighborIndex);
-        float influence = neighborhoodFunction(spatialDistance, neighborhoodRadius);
+void KohonenNetwork::trainStep(const float* input, float learningRate, float neighborhoodRadius) {
+    ownWeights();
+    float squaredDistance;
+    int bmuIndex;
+    {
+        ScopedTimer timer(TelemetryPhase::BmuSearch);
+        bmuIndex = findBestMatchingUnit(input, squaredDistance);
+    }
+    recordQuantizationError(squaredDistance);
+    updateNeighborhood(bmuIndex, input, learningRate, neighborhoodRadius);
+}
 
-        for (size_t i = 0; i < neurons[neighborIndex].weights.size(); ++i) {
-            neurons[neighborIndex].weights[i] += learningRate * influence *
-            (input.pixels[i] - neurons[neighborIndex].weights[i]);
+void KohonenNetwork::trainStep(const uint8_t* pixels, float learningRate, float neighborhoodRadius) {
+    // Decoded exactly as the loaders decode, so a byte step is the float step on
+    // the same values whatever kernels the CPU selects
+    thread_local std::vector<float> decoded;
+    decoded.resize(inputSize);
+    DistanceKernels::decodeU8(pixels, 255.0f, decoded.data(), inputSize);
+    trainStep(decoded.data(), learningRate, neighborhoodRadius);
+}
+
+void KohonenNetwork::trainOnlineEpochApproximate(const Dataset& dataset, int epoch,
+                                                 float learningRate, float neighborhoodRadius) {
+    bool exactEpoch = seedBmus.size() != dataset.size() || epoch % approximateRescanInterval == 0;
+    bool measureRecall = exactEpoch && seedBmus.size() == dataset.size();
+    if (seedBmus.size() != dataset.size()) {
+        seedBmus.assign(dataset.size(), 0);
+    }
+
+    size_t matches = 0;
+    for (uint32_t index : sampleOrder) {
+        const float* pixels = dataset.sample(index);
+        float squaredDistance;
+        int bmu;
+        {
+            ScopedTimer timer(TelemetryPhase::BmuSearch);
+            if (exactEpoch) {
+                bmu = findBestMatchingUnit(pixels, squaredDistance, measureRecall ? seedBmus[index] : -1);
+                // Recall of the approximate search against the exact answer, at no extra
+                // cost to the epochs that actually run approximately. A climb that ends on
+                // another neuron at the same distance found a BMU too.
+                float climbedDistance;
+                if (measureRecall &&
+                    (hillClimbBestMatchingUnit(pixels, seedBmus[index], climbedDistance) == bmu ||
+                     climbedDistance <= squaredDistance * (1.0f + recallTieTolerance))) {
+                    matches++;
+                }
+            } else {
+                bmu = hillClimbBestMatchingUnit(pixels, seedBmus[index], squaredDistance);
+            }
         }
+
+        seedBmus[index] = bmu;
+        recordQuantizationError(squaredDistance);
+        updateNeighborhood(bmu, pixels, learningRate, neighborhoodRadius);
     }
 
-    neurons[bmuIndex].activationCount++;
+    if (measureRecall && !dataset.empty()) {
+        approximateRecall = static_cast<float>(matches) / dataset.size();
+    }
 }
 
-int KohonenNetwork::findBestMatchingUnit(const std::vector<float>& input) {
-    int bestIndex = 0;
-    float minDistance = calculateDistance(input, neurons[0]);
+void KohonenNetwork::trainOnlineEpochPruned(const Dataset& dataset, float learningRate,
+                                            float neighborhoodRadius) {
+    if (seedBmus.size() != dataset.size()) {
+        seedBmus.assign(dataset.size(), -1);
+    }
+
+    for (uint32_t index : sampleOrder) {
+        const float* pixels = dataset.sample(index);
+        float squaredDistance;
+        int bmu;
+        {
+            ScopedTimer timer(TelemetryPhase::BmuSearch);
+            bmu = findBestMatchingUnit(pixels, squaredDistance, seedBmus[index]);
+        }
+        seedBmus[index] = bmu;
+        recordQuantizationError(squaredDistance);
+        updateNeighborhood(bmu, pixels, learningRate, neighborhoodRadius);
+    }
+}
+
+void KohonenNetwork::updatePruneBlockOrder(const Dataset& dataset) {
+    if (dataset.empty()) return;
+    const size_t block = DistanceKernels::pruneBlockSize;
+    size_t numBlocks = (static_cast<size_t>(inputSize) + block - 1) / block;
+
+    // Per-dimension variance, summed per block: blocks that differ most between
+    // samples are the ones most likely to push a wrong neuron past the bound
+    std::vector<double> sum(inputSize, 0.0), sumSquares(inputSize, 0.0);
+    for (size_t s = 0; s < dataset.size(); ++s) {
+        const float* sample = dataset.sample(s);
+        for (int i = 0; i < inputSize; ++i) {
+            sum[i] += sample[i];
+            sumSquares[i] += sample[i] * sample[i];
+        }
+    }
+
+    std::vector<double> blockVariance(numBlocks, 0.0);
+    for (int i = 0; i < inputSize; ++i) {
+        double mean = sum[i] / dataset.size();
+        blockVariance[i / block] += sumSquares[i] / dataset.size() - mean * mean;
+    }
+
+    std::vector<uint32_t> blocks(numBlocks);
+    std::iota(blocks.begin(), blocks.end(), 0u);
+    std::stable_sort(blocks.begin(), blocks.end(), [&](uint32_t a, uint32_t b) {
+        return blockVariance[a] > blockVariance[b];
+    });
+
+    pruneBlockOrder.resize(numBlocks);
+    for (size_t k = 0; k < numBlocks; ++k) {
+        pruneBlockOrder[k] = static_cast<uint32_t>(blocks[k] * block);
+    }
+}
+
+int KohonenNetwork::hillClimbBestMatchingUnit(const float* input, int seed, float& squaredDistance) const {
+    int current = seed;
+    float best = DistanceKernels::squaredL2(input, getWeights(current), inputSize);
+
+    // Move to the best of the 26 lattice neighbors until none improves
+    while (true) {
+        int cx, cy, cz;
+        getXYZ(current, cx, cy, cz);
+        int next = current;
+
+        for (int z = std::max(cz - 1, 0); z <= std::min(cz + 1, depth - 1); ++z) {
+            for (int y = std::max(cy - 1, 0); y <= std::min(cy + 1, height - 1); ++y) {
+                for (int x = std::max(cx - 1, 0); x <= std::min(cx + 1, width - 1); ++x) {
+                    int candidate = get3DIndex(x, y, z);
+                    if (candidate == current) continue;
+                    float distance = DistanceKernels::squaredL2(input, getWeights(candidate), inputSize);
+                    if (distance < best) {
+                        best = distance;
+                        next = candidate;
+                    }
+                }
+            }
+        }
+
+        if (next == current) break;
+        current = next;
+    }
+
+    squaredDistance = best;
+    return current;
+}
+
+void KohonenNetwork::updateNeighborhood(int bmuIndex, const float* input, float learningRate,
+                                        float neighborhoodRadius) {
+    updateNeighborhoodWeights(bmuIndex, input, learningRate, neighborhoodStencil(neighborhoodRadius));
+    activationCounts[bmuIndex]++;
+}
+
+void KohonenNetwork::updateNeighborhoodWeights(int bmuIndex, const float* input, float learningRate,
+                                               const NeighborhoodStencil& neighborhood) {
+    updateNeighbors(bmuIndex, learningRate, neighborhood, [&](float* row, float rate) {
+        for (int i = 0; i < inputSize; ++i) {
+            row[i] += rate * (input[i] - row[i]);
+        }
+    });
+}
 
-    for (size_t i = 1; i < neurons.size(); ++i) {
-        float distance = calculateDistance(input, neurons[i]);
-        if (distance < minDistance) {
-            minDistance = distance;
-            bestIndex = i;
+void KohonenNetwork::trainHogwildEpoch(const Dataset& dataset, float learningRate,
+                                       float neighborhoodRadius) {
+    ownWeights();
+    // Built up front so workers only read it
+    const NeighborhoodStencil& neighborhood = neighborhoodStencil(neighborhoodRadius);
+    if (sampleOrder.size() != dataset.size()) {
+        shuffleSampleOrder(dataset.size());
+    }
+    if (seedBmus.size() != dataset.size()) {
+        seedBmus.assign(dataset.size(), -1);
+    }
+
+    // Each worker takes slices of the shuffled order and applies the online rule
+    // straight to the shared weights. Overlapping neighborhoods race on plain float
+    // writes; as in Hogwild SGD an occasionally lost update is noise the decaying
+    // learning rate absorbs, and the samples per epoch are still all seen once.
+    // BMU searches run inline on the worker, so each sample's search is sequential.
+    std::vector<int> epochBmus(sampleOrder.size());
+    std::vector<float> epochDistances(sampleOrder.size());
+    pool->parallelFor(sampleOrder.size(), minSamplesPerChunk, [&](size_t begin, size_t end, int) {
+        for (size_t s = begin; s < end; ++s) {
+            uint32_t index = sampleOrder[s];
+            const float* pixels = dataset.sample(index);
+            float squaredDistance;
+            int bmu;
+            {
+                ScopedTimer timer(TelemetryPhase::BmuSearch);
+                bmu = findBestMatchingUnit(pixels, squaredDistance, seedBmus[index]);
+            }
+            seedBmus[index] = bmu;
+            epochBmus[s] = bmu;
+            epochDistances[s] = squaredDistance;
+            updateNeighborhoodWeights(bmu, pixels, learningRate, neighborhood);
         }
+    });
+
+    for (size_t s = 0; s < epochBmus.size(); ++s) {
+        activationCounts[epochBmus[s]]++;
+        recordQuantizationError(epochDistances[s]);
+    }
+}
+
+template <typename Scan>
+int KohonenNetwork::scanBestMatchingUnit(const Scan& scan, float& squaredDistance) const {
+    if (pool->size() == 1 || static_cast<size_t>(numNeurons) * inputSize < parallelSearchMinWeights) {
+        return scan(0, numNeurons, squaredDistance);
+    }
+
+    // Each worker scans whole neuron ranges; ties go to the lowest index so the
+    // result does not depend on how the range was split
+    std::vector<BestMatch> best(pool->size(), {std::numeric_limits<float>::max(), numNeurons});
+    pool->parallelFor(numNeurons, minNeuronsPerChunk, [&](size_t begin, size_t end, int worker) {
+        BestMatch match;
+        match.index = scan(static_cast<int>(begin), static_cast<int>(end), match.distance);
+        if (match.betterThan(best[worker])) best[worker] = match;
+    });
+
+    BestMatch result = best[0];
+    for (size_t i = 1; i < best.size(); ++i) {
+        if (best[i].betterThan(result)) result = best[i];
+    }
+    squaredDistance = result.distance;
+    return result.index;
+}
+
+int KohonenNetwork::findBestMatchingUnit(const std::vector<float>& input) {
+    float squaredDistance;
+    return findBestMatchingUnit(input.data(), squaredDistance);
+}
+
+int KohonenNetwork::findBestMatchingUnit(const float* input, float& squaredDistance, int seed) const {
+    if (!searchIndex.empty()) {
+        return searchIndex.nearest(input, squaredDistance);
+    }
+    if (prunedSearch) {
+        return findBestMatchingUnitPruned(input, squaredDistance, seed);
+    }
+
+    // Ranking uses squared distances; callers take the sqrt only when they report it
+    return scanBestMatchingUnit([&](int begin, int end, float& distance) {
+        return DistanceKernels::argminSquaredL2(input, weightData, weightStride, inputSize, begin, end, distance);
+    }, squaredDistance);
+}
+
+int KohonenNetwork::findBestMatchingUnitPruned(const float* input, float& squaredDistance, int seed) const {
+    const uint32_t* blockOrder = pruneBlockOrder.empty() ? nullptr : pruneBlockOrder.data();
+
+    // The seed's distance, summed the same way as the scan, is the initial bound
+    float bound = std::numeric_limits<float>::max();
+    if (seed >= 0 && seed < numNeurons) {
+        DistanceKernels::argminSquaredL2Pruned(input, weightData, weightStride, inputSize,
+                                               blockOrder, seed, seed + 1, bound);
+    }
+
+    if (pool->size() == 1 || static_cast<size_t>(numNeurons) * inputSize < parallelSearchMinWeights) {
+        squaredDistance = bound;
+        return DistanceKernels::argminSquaredL2Pruned(input, weightData, weightStride, inputSize,
+                                                      blockOrder, 0, numNeurons, squaredDistance);
+    }
+
+    // Workers share the seed bound but not each other's improvements, so the
+    // result is independent of scheduling
+    std::vector<BestMatch> best(pool->size(), {std::numeric_limits<float>::max(), numNeurons});
+    pool->parallelFor(numNeurons, minNeuronsPerChunk, [&](size_t begin, size_t end, int worker) {
+        BestMatch match;
+        match.distance = bound;
+        match.index = DistanceKernels::argminSquaredL2Pruned(input, weightData, weightStride, inputSize,
+                                                             blockOrder, static_cast<int>(begin),
+                                                             static_cast<int>(end), match.distance);
+        if (match.index >= 0 && match.betterThan(best[worker])) best[worker] = match;
+    });
+
+    BestMatch result = best[0];
+    for (size_t i = 1; i < best.size(); ++i) {
+        if (best[i].betterThan(result)) result = best[i];
+    }
+    squaredDistance = result.distance;
+    return result.index;
+}
+
+std::vector<float> KohonenNetwork::computeWeightNorms() const {
+    std::vector<float> weightNorms(numNeurons);
+    DistanceKernels::squaredNorms(weightData, weightStride, inputSize, numNeurons, weightNorms.data());
+    return weightNorms;
+}
+
+void KohonenNetwork::findBestMatchingUnits(const float* const* samples, size_t count,
+                                           int* bmus, float* squaredDistances) const {
+    std::vector<float> weightNorms = computeWeightNorms();
+    DistanceKernels::argminSquaredL2Batch(samples, count, weightData, weightStride, weightNorms.data(),
+                                          inputSize, numNeurons, bmus, squaredDistances);
+}
+
+void KohonenNetwork::assignBestMatchingUnits(const Dataset& dataset,
+                                             std::vector<int>& bmus,
+                                             std::vector<float>& squaredDistances) const {
+    std::vector<const float*> samples(dataset.size());
+    for (size_t i = 0; i < dataset.size(); ++i) {
+        samples[i] = dataset.sample(i);
     }
 
-    return bestIndex;
+    bmus.resize(dataset.size());
+    squaredDistances.resize(dataset.size());
+    assignBestMatchingUnits(samples.data(), samples.size(), bmus.data(), squaredDistances.data());
 }
 
-float KohonenNetwork::calculateDistance(const std::vector<float>& input, const Neuron& neuron) {
-    float distance = 0.0f;
-    for (size_t i = 0; i < input.size(); ++i) {
-        float diff = input[i] - neuron.weights[i];
-        distance += diff * diff;
+void KohonenNetwork::assignBestMatchingUnits(const float* const* samples, size_t count,
+                                             int* bmus, float* squaredDistances) const {
+    if (!searchIndex.empty() && !searchIndex.getStats().bruteForce) {
+        pool->parallelFor(count, minSamplesPerChunk, [&](size_t begin, size_t end, int) {
+            for (size_t i = begin; i < end; ++i) {
+                bmus[i] = searchIndex.nearest(samples[i], squaredDistances[i]);
+            }
+        });
+        return;
     }
-    return std::sqrt(distance);
+
+    // Weight norms are fixed for the whole pass
+    std::vector<float> weightNorms = computeWeightNorms();
+
+    pool->parallelFor(count, minSamplesPerChunk, [&](size_t begin, size_t end, int) {
+        DistanceKernels::argminSquaredL2Batch(samples + begin, end - begin, weightData, weightStride,
+                                              weightNorms.data(), inputSize, numNeurons,
+                                              bmus + begin, squaredDistances + begin);
+    });
+}
+
+void KohonenNetwork::assignBestMatchingUnits(const ByteMatrix& samples, int* bmus, float* squaredDistances) const {
+    if (inferencePrecision == InferencePrecision::Int8) {
+        pool->parallelFor(samples.rows, minSamplesPerChunk, [&](size_t begin, size_t end, int) {
+            for (size_t i = begin; i < end; ++i) {
+                bmus[i] = findBestMatchingUnitQuantized(samples.row(i), squaredDistances[i]);
+            }
+        });
+        return;
+    }
+
+    bool useIndex = !searchIndex.empty() && !searchIndex.getStats().bruteForce;
+    std::vector<float> weightNorms;
+    if (!useIndex) weightNorms = computeWeightNorms();
+
+    // The float kernels get a small worker-local block at a time, which stays in
+    // cache, so the dataset is never expanded to floats as a whole
+    pool->parallelFor(samples.rows, minSamplesPerChunk, [&](size_t begin, size_t end, int) {
+        std::vector<float> decoded(decodeBlockSamples * inputSize);
+        const float* pointers[decodeBlockSamples];
+        for (size_t block = begin; block < end; block += decodeBlockSamples) {
+            size_t count = std::min(decodeBlockSamples, end - block);
+            for (size_t i = 0; i < count; ++i) {
+                float* target = decoded.data() + i * inputSize;
+                DistanceKernels::decodeU8(samples.row(block + i), 255.0f, target, inputSize);
+                pointers[i] = target;
+            }
+
+            if (useIndex) {
+                for (size_t i = 0; i < count; ++i) {
+                    bmus[block + i] = searchIndex.nearest(pointers[i], squaredDistances[block + i]);
+                }
+            } else {
+                DistanceKernels::argminSquaredL2Batch(pointers, count, weightData, weightStride,
+                                                      weightNorms.data(), inputSize, numNeurons,
+                                                      bmus + block, squaredDistances + block);
+            }
+        }
+    });
+}
+
+float KohonenNetwork::calculateDistance(const std::vector<float>& input, int neuronIndex) {
+    return std::sqrt(DistanceKernels::squaredL2(input.data(), getWeights(neuronIndex), inputSize));
 }
 
 float KohonenNetwork::calculateSpatialDistance(int neuron1, int neuron2) {
@@ -131,99 +1017,462 @@ float KohonenNetwork::calculateSpatialDistance(int neuron1, int neuron2) {
 std::vector<int> KohonenNetwork::getNeighbors(int neuronIndex, float radius) {
     std::vector<int> neighbors;
 
-    for (size_t i = 0; i < neurons.size(); ++i) {
-        if (calculateSpatialDistance(neuronIndex, i) <= radius) {
-            neighbors.push_back(i);
-        }
+    int cx, cy, cz;
+    getXYZ(neuronIndex, cx, cy, cz);
+
+    for (const StencilOffset& offset : neighborhoodStencil(radius).offsets) {
+        int x = cx + offset.dx;
+        int y = cy + offset.dy;
+        int z = cz + offset.dz;
+        if (x < 0 || x >= width || y < 0 || y >= height || z < 0 || z >= depth) continue;
+        neighbors.push_back(get3DIndex(x, y, z));
     }
 
     return neighbors;
 }
 
+const NeighborhoodStencil& KohonenNetwork::neighborhoodStencil(float radius) {
+    if (radius == stencil.radius) return stencil;
+
+    stencil.radius = radius;
+    stencil.offsets.clear();
+
+    if (radius <= 0) {
+        stencil.offsets.push_back({0, 0, 0, 1.0f});
+        return stencil;
+    }
+
+    // The 3D Gaussian is separable: exp(-(dx^2+dy^2+dz^2)/2r^2) = g(dx) g(dy) g(dz)
+    int reach = std::min(static_cast<int>(radius), std::max(width, std::max(height, depth)));
+    std::vector<float> gaussian(reach + 1);
+    for (int d = 0; d <= reach; ++d) {
+        gaussian[d] = neighborhoodFunction(static_cast<float>(d), radius);
+    }
+
+    for (int dz = -reach; dz <= reach; ++dz) {
+        for (int dy = -reach; dy <= reach; ++dy) {
+            for (int dx = -reach; dx <= reach; ++dx) {
+                float distance = std::sqrt(static_cast<float>(dx*dx + dy*dy + dz*dz));
+                if (distance > radius) continue;
+                float influence = gaussian[std::abs(dx)] * gaussian[std::abs(dy)] * gaussian[std::abs(dz)];
+                stencil.offsets.push_back({dx, dy, dz, influence});
+            }
+        }
+    }
+
+    return stencil;
+}
+
+void KohonenNetwork::trainBatchEpoch(const Dataset& dataset, float neighborhoodRadius) {
+    ownWeights();
+    // 1. BMUs of every sample against the frozen weights
+    std::vector<int> bmus;
+    std::vector<float> squaredDistances;
+    {
+        ScopedTimer timer(TelemetryPhase::BmuSearch);
+        assignBestMatchingUnits(dataset, bmus, squaredDistances);
+    }
+    ScopedTimer updateTimer(TelemetryPhase::NeighborhoodUpdate);
+    for (float squaredDistance : squaredDistances) {
+        recordQuantizationError(squaredDistance);
+    }
+
+    // 2. Per-neuron sums of the samples each neuron won. Members are bucketed in
+    //    sample order and every neuron is summed by exactly one worker, so the
+    //    floating point result is the same for any thread count.
+    std::vector<size_t> memberOffsets(numNeurons + 1, 0);
+    for (int bmu : bmus) {
+        memberOffsets[bmu + 1]++;
+    }
+    for (int i = 0; i < numNeurons; ++i) {
+        memberOffsets[i + 1] += memberOffsets[i];
+    }
+    std::vector<size_t> members(dataset.size());
+    std::vector<size_t> fill(memberOffsets.begin(), memberOffsets.end() - 1);
+    for (size_t i = 0; i < dataset.size(); ++i) {
+        members[fill[bmus[i]]++] = i;
+    }
+
+    AlignedVector<float> sums(numNeurons * weightStride, 0.0f);
+    std::vector<int> hits(numNeurons);
+    std::vector<int> wonNeurons;
+    for (int i = 0; i < numNeurons; ++i) {
+        hits[i] = static_cast<int>(memberOffsets[i + 1] - memberOffsets[i]);
+        if (hits[i] > 0) wonNeurons.push_back(i);
+    }
+
+    pool->parallelFor(wonNeurons.size(), 1, [&](size_t begin, size_t end, int) {
+        for (size_t w = begin; w < end; ++w) {
+            int neuron = wonNeurons[w];
+            float* sum = sums.data() + neuron * weightStride;
+            for (size_t m = memberOffsets[neuron]; m < memberOffsets[neuron + 1]; ++m) {
+                const float* pixels = dataset.sample(members[m]);
+                for (int i = 0; i < inputSize; ++i) {
+                    sum[i] += pixels[i];
+                }
+            }
+        }
+    });
+
+    // 3. Solve w_k = sum_j h(j,k) S_j / sum_j h(j,k) n_j; each output row is
+    //    independent and visits its neighbors in index order
+    const NeighborhoodStencil& neighborhood = neighborhoodStencil(neighborhoodRadius);
+
+    pool->parallelFor(numNeurons, 1, [&](size_t begin, size_t end, int) {
+        std::vector<float> numerator(inputSize);
+        uint64_t updated = 0;
+        for (size_t k = begin; k < end; ++k) {
+            std::fill(numerator.begin(), numerator.end(), 0.0f);
+            float denominator = 0.0f;
+
+            int cx, cy, cz;
+            getXYZ(static_cast<int>(k), cx, cy, cz);
+
+            for (const StencilOffset& offset : neighborhood.offsets) {
+                int x = cx + offset.dx;
+                int y = cy + offset.dy;
+                int z = cz + offset.dz;
+                if (x < 0 || x >= width || y < 0 || y >= height || z < 0 || z >= depth) continue;
+
+                int j = get3DIndex(x, y, z);
+                if (hits[j] == 0) continue;
+                updated += hits[j];
+                const float* sum = sums.data() + j * weightStride;
+                for (int i = 0; i < inputSize; ++i) {
+                    numerator[i] += offset.influence * sum[i];
+                }
+                denominator += offset.influence * hits[j];
+            }
+
+            if (denominator > 0.0f) {
+                float* row = weightRow(static_cast<int>(k));
+                for (int i = 0; i < inputSize; ++i) {
+                    row[i] = numerator[i] / denominator;
+                }
+            }
+        }
+
+        Telemetry::countNeuronUpdates(updated);
+    });
+
+    for (int i = 0; i < numNeurons; ++i) {
+        activationCounts[i] += hits[i];
+    }
+}
+
 float KohonenNetwork::neighborhoodFunction(float distance, float radius) {
     if (radius <= 0) return distance == 0 ? 1.0f : 0.0f;
     return std::exp(-(distance * distance) / (2 * radius * radius));
 }
 
-void KohonenNetwork::classifyNeurons(const std::vector<MNISTImage>& dataset) {
-    // Count class activations for each neuron
-    std::vector<std::map<int, int>> neuronClassCounts(neurons.size());
+void KohonenNetwork::labelNeurons(const Dataset& dataset) {
+    ScopedTimer timer(TelemetryPhase::Labeling);
+    LabelingPass pass = beginLabeling(dataset.size());
+    labelChunk(dataset, 0, pass);
+    finishLabeling(pass);
+}
+
+KohonenNetwork::LabelingPass KohonenNetwork::beginLabeling(size_t count) {
+    LabelingPass pass;
+    pass.labels.assign(count, -1);
+    pass.prototypeDistances.assign(numNeurons, std::numeric_limits<float>::max());
+    sampleAssignments.resize(count);
+    prototypeIndices.assign(numNeurons, -1);
+    return pass;
+}
+
+void KohonenNetwork::labelChunk(const Dataset& samples, size_t first, LabelingPass& pass) {
+    // BMUs through the search index when one is built, brute force otherwise
+    std::vector<const float*> rows(samples.size());
+    std::vector<int> bmus(samples.size());
+    std::vector<float> distances(samples.size());
+    for (size_t i = 0; i < samples.size(); ++i) {
+        rows[i] = samples.sample(i);
+    }
+    assignBestMatchingUnits(rows.data(), rows.size(), bmus.data(), distances.data());
 
-    for (const auto& sample : dataset) {
-        int bmu = findBestMatchingUnit(sample.pixels);
-        neuronClassCounts[bmu][sample.label]++;
+    for (size_t i = 0; i < samples.size(); ++i) {
+        sampleAssignments[first + i] = {static_cast<uint32_t>(bmus[i]), distances[i]};
+        pass.labels[first + i] = samples.label(i);
     }
 
-    // Assign dominant class to each neuron
-    for (size_t i = 0; i < neurons.size(); ++i) {
-        if (!neuronClassCounts[i].empty()) {
-            auto maxElement = std::max_element(neuronClassCounts[i].begin(),
-                                               neuronClassCounts[i].end(),
-                                               [](const auto& a, const auto& b) {
-                                                   return a.second < b.second;
-                                               });
-            neurons[i].dominantClass = maxElement->first;
+    // Prototypes: the nearest sample so far, the lowest index on ties since
+    // samples are visited in order. Pixels are copied while the chunk is at hand.
+    for (size_t i = 0; i < samples.size(); ++i) {
+        const SampleAssignment& assignment = sampleAssignments[first + i];
+        if (assignment.squaredDistance < pass.prototypeDistances[assignment.bmu]) {
+            pass.prototypeDistances[assignment.bmu] = assignment.squaredDistance;
+            prototypeIndices[assignment.bmu] = static_cast<int>(first + i);
+        }
+    }
+    for (int n = 0; n < numNeurons; ++n) {
+        if (prototypeIndices[n] >= static_cast<int>(first)) {
+            const float* pixels = samples.sample(prototypeIndices[n] - first);
+            std::copy(pixels, pixels + inputSize, prototypeImages.begin() + static_cast<size_t>(n) * inputSize);
         }
     }
 }
 
+void KohonenNetwork::finishLabeling(const LabelingPass& pass) {
+    int numClasses = 0;
+    for (int label : pass.labels) {
+        numClasses = std::max(numClasses, label + 1);
+    }
 
-void KohonenNetwork::findPrototypeImages(const std::vector<MNISTImage>& dataset) {
-    // For each neuron, find the training image that activates it most strongly
-    std::vector<float> bestDistance(neurons.size(), std::numeric_limits<float>::max());
-
-    for (const auto& sample : dataset) {
-        int bmu = findBestMatchingUnit(sample.pixels);
-        float distance = calculateDistance(sample.pixels, neurons[bmu]);
+    classCount = numClasses;
+    classHistograms.assign(static_cast<size_t>(numNeurons) * numClasses, 0);
+    hitCounts.assign(numNeurons, 0);
+    for (size_t i = 0; i < pass.labels.size(); ++i) {
+        if (pass.labels[i] >= 0) {
+            classHistograms[static_cast<size_t>(sampleAssignments[i].bmu) * numClasses + pass.labels[i]]++;
+        }
+    }
 
-        if (distance < bestDistance[bmu]) {
-            bestDistance[bmu] = distance;
-            neurons[bmu].prototypeImage = sample.pixels;
+    // Ties resolve to the lowest class
+    for (int n = 0; n < numNeurons; ++n) {
+        const int* histogram = &classHistograms[static_cast<size_t>(n) * numClasses];
+        int dominant = -1;
+        for (int c = 0; c < numClasses; ++c) {
+            hitCounts[n] += histogram[c];
+            if (histogram[c] > 0 && (dominant < 0 || histogram[c] > histogram[dominant])) {
+                dominant = c;
+            }
         }
+        dominantClasses[n] = dominant;
     }
 
-    std::cout << "Found prototype images for neurons" << std::endl;
+    std::cout << "Labeled neurons and found prototype images" << std::endl;
 }
 
-
-
 ClassificationResult KohonenNetwork::classifySample(const MNISTImage& sample) {
     ClassificationResult result;
     result.trueLabel = sample.label;
 
-    int bmuIndex = findBestMatchingUnit(sample.pixels);
-    result.predictedLabel = neurons[bmuIndex].dominantClass;
-    result.confidence = calculateDistance(sample.pixels, neurons[bmuIndex]);
+    float squaredDistance;
+    int bmuIndex;
+    if (inferencePrecision == InferencePrecision::Int8) {
+        std::vector<uint8_t> scratch(inputSize);
+        bmuIndex = findBestMatchingUnitQuantized(sample.pixels.data(), scratch.data(), squaredDistance);
+    } else {
+        bmuIndex = findBestMatchingUnit(sample.pixels.data(), squaredDistance);
+    }
+    result.predictedLabel = dominantClasses[bmuIndex];
+    result.confidence = std::sqrt(squaredDistance);
 
     return result;
 }
 
 
 
-MetricsReport KohonenNetwork::evaluateOnDataset(const std::vector<MNISTImage>& testDataset) {
-    std::cout << "Evaluating network on test dataset..." << std::endl;
+void KohonenNetwork::classifyBatch(const float* const* samples, size_t count,
+                                   ClassificationResult* results) const {
+    std::vector<int> bmus(count);
+    std::vector<float> squaredDistances(count);
+
+    if (inferencePrecision == InferencePrecision::Int8) {
+        pool->parallelFor(count, minSamplesPerChunk, [&](size_t begin, size_t end, int) {
+            std::vector<uint8_t> scratch(inputSize);
+            for (size_t i = begin; i < end; ++i) {
+                bmus[i] = findBestMatchingUnitQuantized(samples[i], scratch.data(), squaredDistances[i]);
+            }
+        });
+    } else {
+        assignBestMatchingUnits(samples, count, bmus.data(), squaredDistances.data());
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        results[i].predictedLabel = dominantClasses[bmus[i]];
+        results[i].trueLabel = -1;
+        results[i].confidence = std::sqrt(squaredDistances[i]);
+    }
+}
+
+void KohonenNetwork::classifyBatch(const ByteMatrix& samples, ClassificationResult* results) const {
+    std::vector<int> bmus(samples.rows);
+    std::vector<float> squaredDistances(samples.rows);
+    assignBestMatchingUnits(samples, bmus.data(), squaredDistances.data());
+
+    for (size_t i = 0; i < samples.rows; ++i) {
+        results[i].predictedLabel = dominantClasses[bmus[i]];
+        results[i].trueLabel = -1;
+        results[i].confidence = std::sqrt(squaredDistances[i]);
+    }
+}
 
-    std::vector<ClassificationResult> results;
-    results.reserve(testDataset.size());
+MetricsReport KohonenNetwork::evaluateOnDataset(const ByteMatrix& images, const uint8_t* labels, DatasetType type) {
+    ScopedTimer timer(TelemetryPhase::Evaluation);
+    std::cout << "Evaluating network on " << images.rows << " mapped samples"
+              << (inferencePrecision == InferencePrecision::Int8 ? " (int8)" : "") << "..." << std::endl;
 
-    for (const auto& sample : testDataset) {
-        results.push_back(classifySample(sample));
+    std::vector<ClassificationResult> results(images.rows);
+    classifyBatch(images, results.data());
+    for (size_t i = 0; i < images.rows; ++i) {
+        results[i].trueLabel = labels[i];
     }
 
-    DatasetType evalType = testDataset.empty() ? currentDatasetType : testDataset[0].type;
+    MetricsReport report = Metrics::evaluateClassification(results, type);
+    std::cout << "Evaluation completed!" << std::endl;
+    return report;
+}
+
+MetricsReport KohonenNetwork::evaluateOnDataset(const Dataset& testDataset) {
+    ScopedTimer timer(TelemetryPhase::Evaluation);
+    std::cout << "Evaluating network on test dataset"
+              << (inferencePrecision == InferencePrecision::Int8 ? " (int8)" : "") << "..." << std::endl;
+
+    std::vector<int> bmus;
+    std::vector<float> squaredDistances;
+    if (inferencePrecision == InferencePrecision::Int8) {
+        assignBestMatchingUnitsQuantized(testDataset, bmus, squaredDistances);
+    } else {
+        assignBestMatchingUnits(testDataset, bmus, squaredDistances);
+    }
+
+    std::vector<ClassificationResult> results = resultsFromAssignments(testDataset, bmus, squaredDistances);
+
+    if (!searchIndex.empty() && inferencePrecision == InferencePrecision::Float32) {
+        MetricTreeStats stats = searchIndex.getStats();
+        if (stats.bruteForce) {
+            std::cout << "Search index: linear scan" << std::endl;
+        } else {
+            std::cout << "Search index: " << stats.scanFraction() * 100 << "% of neurons compared per query ("
+                      << stats.queries << " queries)" << std::endl;
+        }
+    }
+
+    DatasetType evalType = testDataset.empty() ? currentDatasetType : testDataset.getType();
     MetricsReport report = Metrics::evaluateClassification(results, evalType);
 
     std::cout << "Evaluation completed!" << std::endl;
     return report;
 }
 
+std::vector<ClassificationResult> KohonenNetwork::resultsFromAssignments(const Dataset& dataset,
+                                                                         const std::vector<int>& bmus,
+                                                                         const std::vector<float>& squaredDistances) const {
+    std::vector<ClassificationResult> results(dataset.size());
+    for (size_t i = 0; i < dataset.size(); ++i) {
+        results[i].trueLabel = dataset.label(i);
+        results[i].predictedLabel = dominantClasses[bmus[i]];
+        results[i].confidence = std::sqrt(squaredDistances[i]);
+    }
+    return results;
+}
+
+void KohonenNetwork::freezeQuantized() {
+    quantizedStride = (static_cast<size_t>(inputSize) + 63) & ~static_cast<size_t>(63);
+    quantizedWeights.assign(numNeurons * quantizedStride, 0);
+    quantizedScales.resize(numNeurons);
+    quantizedNorms.resize(numNeurons);
+
+    for (int n = 0; n < numNeurons; ++n) {
+        const float* row = getWeights(n);
+        float maxAbs = 0.0f;
+        for (int i = 0; i < inputSize; ++i) {
+            maxAbs = std::max(maxAbs, std::fabs(row[i]));
+        }
+
+        // Symmetric per-neuron scale onto [-127, 127]
+        float scale = maxAbs > 0.0f ? maxAbs / 127.0f : 1.0f;
+        int8_t* quantized = quantizedWeights.data() + n * quantizedStride;
+        float norm = 0.0f;
+        for (int i = 0; i < inputSize; ++i) {
+            float q = std::round(row[i] / scale);
+            quantized[i] = static_cast<int8_t>(std::max(-127.0f, std::min(127.0f, q)));
+            float dequantized = quantized[i] * scale;
+            norm += dequantized * dequantized;
+        }
+
+        quantizedScales[n] = scale / 255.0f;
+        quantizedNorms[n] = norm;
+    }
+
+    std::cout << "Froze int8 weights (" << (quantizedWeights.size() >> 10) << " KiB, "
+              << (DistanceKernels::hasVnni() ? "VNNI" : DistanceKernels::isaName(DistanceKernels::activeIsa()))
+              << " integer kernels)" << std::endl;
+}
+
+void KohonenNetwork::setInferencePrecision(InferencePrecision precision) {
+    if (precision == InferencePrecision::Int8 && quantizedWeights.empty()) {
+        freezeQuantized();
+    }
+    inferencePrecision = precision;
+}
+
+int KohonenNetwork::findBestMatchingUnitQuantized(const float* input, uint8_t* scratch,
+                                                  float& squaredDistance) const {
+    // Inputs are [0,1] intensities; as bytes they are exactly the source pixels
+    for (int i = 0; i < inputSize; ++i) {
+        float value = std::max(0.0f, std::min(255.0f, input[i] * 255.0f + 0.5f));
+        scratch[i] = static_cast<uint8_t>(value);
+    }
+    return findBestMatchingUnitQuantized(scratch, squaredDistance);
+}
+
+int KohonenNetwork::findBestMatchingUnitQuantized(const uint8_t* pixels, float& squaredDistance) const {
+    float inputNorm = 0.0f;
+    for (int i = 0; i < inputSize; ++i) {
+        float normalized = pixels[i] / 255.0f;
+        inputNorm += normalized * normalized;
+    }
+
+    float score;
+    int bmu = DistanceKernels::argminQuantized(pixels, quantizedWeights.data(), quantizedStride, inputSize,
+                                               quantizedScales.data(), quantizedNorms.data(), numNeurons, score);
+    squaredDistance = std::max(0.0f, inputNorm + score);
+    return bmu;
+}
+
+void KohonenNetwork::assignBestMatchingUnitsQuantized(const Dataset& dataset,
+                                                      std::vector<int>& bmus,
+                                                      std::vector<float>& squaredDistances) const {
+    bmus.resize(dataset.size());
+    squaredDistances.resize(dataset.size());
+
+    pool->parallelFor(dataset.size(), minSamplesPerChunk, [&](size_t begin, size_t end, int) {
+        std::vector<uint8_t> scratch(inputSize);
+        for (size_t i = begin; i < end; ++i) {
+            bmus[i] = findBestMatchingUnitQuantized(dataset.sample(i), scratch.data(), squaredDistances[i]);
+        }
+    });
+}
+
+QuantizationDrift KohonenNetwork::measureQuantizationDrift(const Dataset& testDataset) {
+    if (quantizedWeights.empty()) {
+        freezeQuantized();
+    }
+
+    std::vector<int> floatBmus, quantizedBmus;
+    std::vector<float> floatDistances, quantizedDistances;
+    assignBestMatchingUnits(testDataset, floatBmus, floatDistances);
+    assignBestMatchingUnitsQuantized(testDataset, quantizedBmus, quantizedDistances);
+
+    QuantizationDrift drift;
+    drift.floatAccuracy = Metrics::calculateAccuracy(resultsFromAssignments(testDataset, floatBmus, floatDistances));
+    drift.quantizedAccuracy = Metrics::calculateAccuracy(
+        resultsFromAssignments(testDataset, quantizedBmus, quantizedDistances));
+
+    size_t agreeing = 0;
+    for (size_t i = 0; i < testDataset.size(); ++i) {
+        if (floatBmus[i] == quantizedBmus[i]) agreeing++;
+    }
+    drift.agreement = testDataset.empty() ? 1.0f : static_cast<float>(agreeing) / testDataset.size();
+
+    std::cout << "Quantization drift: float " << drift.floatAccuracy * 100 << "%, int8 "
+              << drift.quantizedAccuracy * 100 << "% ("
+              << (drift.quantizedAccuracy - drift.floatAccuracy) * 100 << " pts), BMU agreement "
+              << drift.agreement * 100 << "%" << std::endl;
+
+    return drift;
+}
+
 void KohonenNetwork::updateColors() {
     // Color map for different datasets
-    std::vector<std::vector<float>> colors;
+    std::vector<std::vector<float>> palette;
 
     if (currentDatasetType == DatasetType::MNIST) {
         // Colors for MNIST digits 0-9
-        colors = {
+        palette = {
             {1.0f, 0.0f, 0.0f},    // 0 - Red
             {0.0f, 1.0f, 0.0f},    // 1 - Green
             {0.0f, 0.0f, 1.0f},    // 2 - Blue
@@ -237,7 +1486,7 @@ void KohonenNetwork::updateColors() {
         };
     } else {
         // Colors for Fashion-MNIST items 0-9
-        colors = {
+        palette = {
             {0.8f, 0.2f, 0.2f},    // 0 - T-shirt/top - Dark Red
             {0.2f, 0.2f, 0.8f},    // 1 - Trouser - Dark Blue
             {0.6f, 0.4f, 0.8f},    // 2 - Pullover - Purple
@@ -251,11 +1500,13 @@ void KohonenNetwork::updateColors() {
         };
     }
 
-    for (auto& neuron : neurons) {
-        if (neuron.dominantClass >= 0 && neuron.dominantClass < static_cast<int>(colors.size())) {
-            neuron.color = colors[neuron.dominantClass];
+    for (int i = 0; i < numNeurons; ++i) {
+        float* color = &colors[i * 3];
+        int dominantClass = dominantClasses[i];
+        if (dominantClass >= 0 && dominantClass < static_cast<int>(palette.size())) {
+            std::copy(palette[dominantClass].begin(), palette[dominantClass].end(), color);
         } else {
-            neuron.color = {0.3f, 0.3f, 0.3f}; // Default gray
+            color[0] = color[1] = color[2] = 0.3f; // Default gray
         }
     }
 }
@@ -3,21 +3,102 @@
 
 #include <vector>
 #include <random>
+#include <cstddef>
+#include <memory>
+#include <cmath>
+#include <functional>
+#include "AlignedAllocator.h"
+#include "ThreadPool.h"
 #include "MNISTLoader.h"
 #include "Metrics.h"
+#include "MetricTree.h"
+#include "MappedFile.h"
+#include "Checkpoint.h"
 
-struct Neuron {
-    std::vector<float> weights;
+class DatasetStream;
+
+// Read-only view of one neuron; the data itself lives in the network's flat arrays
+struct NeuronView {
+    const float* weights;
     float x, y, z;
     int activationCount;
     int dominantClass;
-    std::vector<float> color;
-    std::vector<float> prototypeImage;
+    int hitCount;  // Training samples mapped to this neuron after training
+    const float* color;
+    const float* prototypeImage;
+};
+
+// Lattice offset within the neighborhood radius and its Gaussian influence
+struct StencilOffset {
+    int dx, dy, dz;
+    float influence;
+};
+
+// All offsets within `radius` of a neuron, ordered so that applying them around
+// any center visits neighbors in increasing index order
+struct NeighborhoodStencil {
+    float radius;
+    std::vector<StencilOffset> offsets;
+};
+
+enum class TrainingMode {
+    Online,  // Classic per-sample update rule
+    Batch,   // Batch SOM: BMUs against frozen weights, one weight solve per epoch
+    Hogwild  // Online rule on all pool threads at once, racing on the shared weights
+};
+
+enum class InferencePrecision {
+    Float32,
+    Int8     // Frozen per-neuron scaled int8 weights, 8-bit inputs
+};
+
+struct QuantizationDrift {
+    float floatAccuracy;
+    float quantizedAccuracy;
+    float agreement;  // Fraction of samples given the same BMU by both paths
+};
 
-    Neuron(int inputSize, float posX, float posY, float posZ)
-    : weights(inputSize), x(posX), y(posY), z(posZ),
-    activationCount(0), dominantClass(-1), color(3, 0.5f),
-    prototypeImage(784, 0.0f) {}
+// Exponential decay of the learning rate and neighborhood radius over a train()
+// run: value(epoch) = initial * exp(-decayRate * epoch / epochs)
+struct TrainingSchedule {
+    float initialLearningRate;
+    float initialRadius;  // <= 0: half the largest lattice dimension
+    float decayRate;
+};
+
+// Per-epoch record of a train() or resumeTraining() run
+struct TrainingHistory {
+    // Mean distance from each sample to its BMU, measured as the epoch ran
+    // (online modes see the weights as they were just before each update)
+    std::vector<float> quantizationErrors;
+    int epochsRun;
+    bool stoppedEarly;
+};
+
+class KohonenNetwork;
+
+class NeuronRange {
+public:
+    class iterator {
+    public:
+        iterator(const KohonenNetwork* network, int index) : network(network), index(index) {}
+        NeuronView operator*() const;
+        iterator& operator++() { ++index; return *this; }
+        bool operator!=(const iterator& other) const { return index != other.index; }
+
+    private:
+        const KohonenNetwork* network;
+        int index;
+    };
+
+    NeuronRange(const KohonenNetwork* network, int count) : network(network), count(count) {}
+    iterator begin() const { return iterator(network, 0); }
+    iterator end() const { return iterator(network, count); }
+    int size() const { return count; }
+
+private:
+    const KohonenNetwork* network;
+    int count;
 };
 
 class KohonenNetwork {
@@ -25,32 +106,292 @@ public:
     KohonenNetwork(int width, int height, int depth, int inputSize);
 
     void initialize();
-    void train(const std::vector<MNISTImage>& dataset, int epochs);
+    TrainingHistory train(const Dataset& dataset, int epochs);
+    // Continues the run saved in a checkpoint up to its original epoch count; the
+    // result matches an uninterrupted train() (except in Hogwild mode)
+    bool resumeTraining(const Dataset& dataset, const std::string& checkpointFile);
+    void trainStep(const float* input, float learningRate, float neighborhoodRadius);
     void trainStep(const MNISTImage& input, float learningRate, float neighborhoodRadius);
+    // Same step for a raw 8-bit sample (e.g. a row of a mapped IDX file), decoded
+    // to [0,1] as the loaders do, so it matches the float step exactly
+    void trainStep(const uint8_t* pixels, float learningRate, float neighborhoodRadius);
+    void trainBatchEpoch(const Dataset& dataset, float neighborhoodRadius);
+    // One online epoch split across the pool without locks; not reproducible between runs
+    void trainHogwildEpoch(const Dataset& dataset, float learningRate, float neighborhoodRadius);
+
+    // Samples [begin, end) of a source read a chunk at a time (e.g. NpyChunkReader);
+    // the returned view only has to stay valid until the next call
+    typedef std::function<Dataset(size_t begin, size_t end)> ChunkReader;
+    // Online training for datasets too large to decode whole: each epoch visits
+    // chunks of chunkSize samples in random order, shuffled within the chunk, and
+    // labeling takes one more pass. Batch/Hogwild modes, pruned and approximate
+    // search and checkpoints need the whole Dataset and are not used.
+    TrainingHistory trainChunked(size_t count, size_t chunkSize, const ChunkReader& readChunk, DatasetType type,
+                                 int epochs);
+    // Online training straight from 8-bit samples, e.g. a mapped IDX file
+    // (MNISTLoader::mapData), so the set stays at 1 byte per pixel instead of 4;
+    // labeling decodes a chunk at a time. The result equals train() on the decoded
+    // Dataset. Batch/Hogwild modes, pruned and approximate search and checkpoints
+    // need float samples, so with any of them the whole set is decoded first.
+    TrainingHistory train(const ByteMatrix& images, const uint8_t* labels, DatasetType type, int epochs);
+    // Starts on the first decoded chunks of a dataset still loading: the first
+    // online epoch visits chunks as they arrive, shuffled within each, and later
+    // epochs run on the whole set. Other modes and searches wait for the load.
+    TrainingHistory train(DatasetStream& stream, int epochs);
+
+    // Per-image datasets are copied into a Dataset on every call
+    TrainingHistory train(const std::vector<MNISTImage>& images, int epochs) {
+        return train(Dataset::fromImages(images), epochs);
+    }
+    bool resumeTraining(const std::vector<MNISTImage>& images, const std::string& checkpointFile) {
+        return resumeTraining(Dataset::fromImages(images), checkpointFile);
+    }
+    void trainBatchEpoch(const std::vector<MNISTImage>& images, float neighborhoodRadius) {
+        trainBatchEpoch(Dataset::fromImages(images), neighborhoodRadius);
+    }
+    void trainHogwildEpoch(const std::vector<MNISTImage>& images, float learningRate, float neighborhoodRadius) {
+        trainHogwildEpoch(Dataset::fromImages(images), learningRate, neighborhoodRadius);
+    }
+
+    void setTrainingMode(TrainingMode mode) { trainingMode = mode; }
+    TrainingMode getTrainingMode() const { return trainingMode; }
+    void setSeed(unsigned int seed) { rng.seed(seed); }
+    void setSchedule(const TrainingSchedule& newSchedule) { schedule = newSchedule; }
+    const TrainingSchedule& getSchedule() const { return schedule; }
+    // Stop once the epoch QE has not improved by more than minRelativeImprovement
+    // on the best so far for `patience` consecutive epochs (patience 0 = never)
+    void setEarlyStopping(float minRelativeImprovement, int patience);
+    const TrainingHistory& getTrainingHistory() const { return history; }
+    // Snapshot the training state every `interval` epochs; written in the background
+    void setCheckpointing(const std::string& filename, int interval);
+    // Online mode visits samples in contiguous blocks of this size, in random block
+    // order and shuffled within each block (0 or 1 = plain full shuffle)
+    void setShuffleBlockSize(size_t blockSize) { shuffleBlockSize = blockSize; }
+
+    // Approximate BMU search for online training: each sample starts from its BMU
+    // of the previous epoch and walks downhill over lattice neighbors. The first
+    // epoch and every rescanInterval-th epoch scan exactly and measure the recall.
+    void setApproximateSearch(bool enabled, int rescanInterval = 10);
+    // Fraction of approximate BMUs as close as the exact one at the last rescan (-1 if unmeasured)
+    float getApproximateRecall() const { return approximateRecall; }
+
+    // Exact BMU search with partial-distance pruning: dimensions are compared in
+    // blocks ordered by training-set variance, and during online training each
+    // sample's previous BMU provides the initial bound
+    void setPrunedSearch(bool enabled) { prunedSearch = enabled; }
+    bool getPrunedSearch() const { return prunedSearch; }
+
+    // Exact VP-tree index over the trained weights, built at the end of train() and
+    // used for classification and evaluation. Maps too small for it to pay off, or
+    // where it stops pruning, are scanned linearly instead. Weight updates outside
+    // train() drop the index until it is enabled again.
+    void setSearchIndex(bool enabled);
+    bool getSearchIndex() const { return searchIndexEnabled; }
+    MetricTreeStats getSearchIndexStats() const { return searchIndex.getStats(); }
 
     int findBestMatchingUnit(const std::vector<float>& input);
-    float calculateDistance(const std::vector<float>& input, const Neuron& neuron);
+    // Batched BMU search for a block of samples, formulated as a matrix multiply
+    void findBestMatchingUnits(const float* const* samples, size_t count,
+                               int* bmus, float* squaredDistances) const;
+    float calculateDistance(const std::vector<float>& input, int neuronIndex);
     float calculateSpatialDistance(int neuron1, int neuron2);
     std::vector<int> getNeighbors(int neuronIndex, float radius);
 
     ClassificationResult classifySample(const MNISTImage& sample);
-    MetricsReport evaluateOnDataset(const std::vector<MNISTImage>& testDataset);
+    // Scores a block of unlabeled samples through the batched BMU path (or the
+    // search index / int8 path when active); trueLabel is set to -1
+    void classifyBatch(const float* const* samples, size_t count, ClassificationResult* results) const;
+    MetricsReport evaluateOnDataset(const Dataset& testDataset);
+    MetricsReport evaluateOnDataset(const std::vector<MNISTImage>& images) {
+        return evaluateOnDataset(Dataset::fromImages(images));
+    }
+    // Scoring straight from raw 8-bit samples (see MNISTLoader::mapData); only a
+    // block of samples per worker is ever decoded to float, and the int8 path
+    // reads the bytes as they are
+    void classifyBatch(const ByteMatrix& samples, ClassificationResult* results) const;
+    MetricsReport evaluateOnDataset(const ByteMatrix& images, const uint8_t* labels,
+                                    DatasetType type = DatasetType::MNIST);
+
+    // Quantizes the trained weights to int8 with one scale per neuron. Any later
+    // weight update (training, trainStep) discards the frozen copy and returns to
+    // float inference.
+    void freezeQuantized();
+    void setInferencePrecision(InferencePrecision precision);
+    InferencePrecision getInferencePrecision() const { return inferencePrecision; }
+    // Scores the dataset with both paths and reports how far int8 drifts from float
+    QuantizationDrift measureQuantizationDrift(const Dataset& testDataset);
+    QuantizationDrift measureQuantizationDrift(const std::vector<MNISTImage>& images) {
+        return measureQuantizationDrift(Dataset::fromImages(images));
+    }
+
     void setDatasetType(DatasetType type) { currentDatasetType = type; }
     DatasetType getDatasetType() const { return currentDatasetType; }
 
-    const std::vector<Neuron>& getNeurons() const { return neurons; }
+    NeuronView getNeuron(int index) const;
+    NeuronRange getNeurons() const { return NeuronRange(this, numNeurons); }
+    int getNumNeurons() const { return numNeurons; }
+    int getInputSize() const { return inputSize; }
+    // Row stride of the weight matrix in floats (inputSize padded to a multiple of 16)
+    size_t getWeightStride() const { return weightStride; }
+    const float* getWeights(int index) const { return weightData + index * weightStride; }
+    // True while weights and prototypes are served from a mapped model file;
+    // training copies them into owned memory first
+    bool isMemoryMapped() const { return mappedModel != nullptr; }
+
     int getWidth() const { return width; }
     int getHeight() const { return height; }
     int getDepth() const { return depth; }
     int getCurrentEpoch() const { return currentEpoch; }
 
+    // Results of the post-training labeling pass, indexed by training sample
+    const std::vector<SampleAssignment>& getSampleAssignments() const { return sampleAssignments; }
+    // Per-class hit counts of a neuron (getNumClasses() entries), or nullptr when
+    // there are none, as for a network loaded from a model file
+    const int* getClassHistogram(int index) const {
+        return classHistograms.empty() ? nullptr : &classHistograms[static_cast<size_t>(index) * classCount];
+    }
+    int getNumClasses() const { return classCount; }
+    // Index of the training sample closest to the neuron, or -1 if it never won
+    int getPrototypeIndex(int index) const { return prototypeIndices.empty() ? -1 : prototypeIndices[index]; }
+
+    // Worker threads used for BMU search and dataset passes (0 = hardware concurrency)
+    void setNumThreads(int numThreads);
+    int getNumThreads() const { return pool->size(); }
+
 private:
+    friend class ModelFile;
+
+    KohonenNetwork(int width, int height, int depth, int inputSize, bool allocate);
+
     int width, height, depth;
     int inputSize;
-    std::vector<Neuron> neurons;
+    int numNeurons;
+    size_t weightStride;
+
+    // numNeurons x weightStride, row-major, zero padded past inputSize
+    AlignedVector<float> weights;
+    std::vector<float> positions;       // x,y,z per neuron
+    std::vector<float> colors;          // r,g,b per neuron
+    std::vector<int> activationCounts;
+    std::vector<int> dominantClasses;
+    std::vector<float> prototypeImages; // numNeurons x inputSize
+
+    // Read paths go through these: they point at the owned buffers above or
+    // into mappedModel
+    const float* weightData;
+    const float* prototypeData;
+    std::shared_ptr<MappedFile> mappedModel;
+
+    std::vector<SampleAssignment> sampleAssignments;
+    std::vector<int> classHistograms;   // numNeurons x classCount
+    std::vector<int> hitCounts;
+    std::vector<int> prototypeIndices;
+    int classCount;
+
     std::mt19937 rng;
     int currentEpoch;
     DatasetType currentDatasetType;
+    TrainingMode trainingMode;
+    TrainingSchedule schedule;
+    std::unique_ptr<ThreadPool> pool;
+    NeighborhoodStencil stencil;
+    std::vector<uint32_t> sampleOrder;  // Reused epoch permutation of sample indices
+    size_t shuffleBlockSize;
+    int checkpointInterval;
+    float earlyStopThreshold;
+    int earlyStopPatience;
+    TrainingHistory history;
+    double epochErrorSum;  // Sum of BMU distances seen so far this epoch
+    size_t epochErrorCount;
+    std::unique_ptr<CheckpointWriter> checkpointWriter;
+
+    InferencePrecision inferencePrecision;
+    size_t quantizedStride;
+    AlignedVector<int8_t> quantizedWeights;  // numNeurons x quantizedStride
+    std::vector<float> quantizedScales;      // Weight scale / 255, folding in the input scale
+    std::vector<float> quantizedNorms;       // ||dequantized w||^2
+
+    int approximateRescanInterval;  // 0 = exact search every epoch
+    std::vector<int> seedBmus;      // Per-sample BMU from the previous epoch
+    float approximateRecall;
+
+    bool prunedSearch;
+    std::vector<uint32_t> pruneBlockOrder;  // Block offsets, highest variance first
+
+    bool searchIndexEnabled;
+    MetricTree searchIndex;  // Empty while training or when disabled
+
+    float* weightRow(int index) { return weights.data() + index * weightStride; }
+    void attachMappedModel(std::shared_ptr<MappedFile> file, const float* mappedWeights,
+                           const float* mappedPrototypes);
+    // Before any weight update: drops the search index and int8 copy and copies
+    // a mapped model into owned storage
+    void ownWeights();
+    void runEpochs(const Dataset& dataset, int firstEpoch, int epochs);
+    void trainEpoch(const Dataset& dataset, int epoch, float learningRate, float neighborhoodRadius);
+    // Learning-rate and radius decay, QE history, early stopping and checkpoints
+    // around trainEpoch(epoch, learningRate, neighborhoodRadius)
+    template <typename TrainEpoch>
+    void runSchedule(size_t count, DatasetType type, int firstEpoch, int epochs, bool checkpoints,
+                     const TrainEpoch& trainEpoch);
+    void finishTraining();
+    void recordQuantizationError(float squaredDistance) {
+        epochErrorSum += std::sqrt(squaredDistance);
+        epochErrorCount++;
+    }
+    bool converged() const;
+    void writeCheckpoint(int epoch, int epochs, float learningRate, float neighborhoodRadius);
+    // seed, if >= 0, is a likely winner whose distance bounds the pruned search
+    int findBestMatchingUnit(const float* input, float& squaredDistance, int seed = -1) const;
+    int findBestMatchingUnitPruned(const float* input, float& squaredDistance, int seed) const;
+    // Full scan of the neurons, split across the pool for large maps; scan(begin, end,
+    // distance) returns the best row of a range
+    template <typename Scan>
+    int scanBestMatchingUnit(const Scan& scan, float& squaredDistance) const;
+    void updatePruneBlockOrder(const Dataset& dataset);
+    void trainOnlineEpochPruned(const Dataset& dataset, float learningRate,
+                                float neighborhoodRadius);
+    void assignBestMatchingUnits(const Dataset& dataset,
+                                 std::vector<int>& bmus, std::vector<float>& squaredDistances) const;
+    void assignBestMatchingUnits(const float* const* samples, size_t count,
+                                 int* bmus, float* squaredDistances) const;
+    void assignBestMatchingUnits(const ByteMatrix& samples, int* bmus, float* squaredDistances) const;
+
+    // Single pass over the training set after training: caches every sample's BMU
+    // and fills class histograms, dominant classes, prototypes and hit counts
+    void labelNeurons(const Dataset& dataset);
+    // The same pass fed a chunk at a time: labelChunk for consecutive chunks
+    // (`first` is the index of the chunk's first sample), then finishLabeling
+    struct LabelingPass {
+        std::vector<int> labels;
+        std::vector<float> prototypeDistances;
+    };
+    LabelingPass beginLabeling(size_t count);
+    void labelChunk(const Dataset& samples, size_t first, LabelingPass& pass);
+    void finishLabeling(const LabelingPass& pass);
+    std::vector<float> computeWeightNorms() const;
+    void buildSearchIndex();
+    void updateNeighborhood(int bmuIndex, const float* input, float learningRate, float neighborhoodRadius);
+    void updateNeighborhoodWeights(int bmuIndex, const float* input, float learningRate,
+                                   const NeighborhoodStencil& neighborhood);
+    // Calls blend(row, rate) for every neuron of the stencil inside the lattice
+    template <typename Blend>
+    void updateNeighbors(int bmuIndex, float learningRate, const NeighborhoodStencil& neighborhood,
+                         const Blend& blend);
+    void trainOnlineEpochApproximate(const Dataset& dataset, int epoch,
+                                     float learningRate, float neighborhoodRadius);
+    int hillClimbBestMatchingUnit(const float* input, int seed, float& squaredDistance) const;
+    int findBestMatchingUnitQuantized(const float* input, uint8_t* scratch, float& squaredDistance) const;
+    int findBestMatchingUnitQuantized(const uint8_t* pixels, float& squaredDistance) const;
+    void assignBestMatchingUnitsQuantized(const Dataset& dataset,
+                                          std::vector<int>& bmus, std::vector<float>& squaredDistances) const;
+    std::vector<ClassificationResult> resultsFromAssignments(const Dataset& dataset,
+                                                             const std::vector<int>& bmus,
+                                                             const std::vector<float>& squaredDistances) const;
+    void updateColors();
+
+    const NeighborhoodStencil& neighborhoodStencil(float radius);
+    void shuffleSampleOrder(size_t count);
 
     int get3DIndex(int x, int y, int z) const;
     void getXYZ(int index, int& x, int& y, int& z) const;
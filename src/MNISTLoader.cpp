@@ -1,5 +1,7 @@
 #include "MNISTLoader.h"
-#include <fstream>
+#include "DatasetCache.h"
+#include "Telemetry.h"
+#include "DistanceKernels.h"
 #include <iostream>
 #include <algorithm>
 
@@ -36,123 +38,86 @@ std::vector<std::string> MNISTLoader::getAllLabelNames(DatasetType type)
     return {};
 }
 
-std::vector<MNISTImage> MNISTLoader::loadTrainingData(const std::string &imagesPath,
-                                                      const std::string &labelsPath,
-                                                      DatasetType type,
-                                                      int maxSamples)
+bool MNISTLoader::mapData(const std::string &imagesPath,
+                          const std::string &labelsPath,
+                          std::shared_ptr<IdxFile> &images,
+                          std::shared_ptr<IdxFile> &labels)
 {
-    auto images = readImages(imagesPath, maxSamples);
-    auto labels = readLabels(labelsPath, maxSamples);
-
-    std::vector<MNISTImage> dataset;
-    dataset.reserve(images.size());
-
-    for (size_t i = 0; i < images.size() && i < labels.size(); ++i)
+    images = IdxFile::open(imagesPath);
+    labels = IdxFile::open(labelsPath);
+    if (!images || !labels)
     {
-        MNISTImage img;
-        img.label = labels[i];
-        img.type = type;
-        img.pixels.reserve(784); // 28x28
-
-        // Normalize pixels to [0,1]
-        for (unsigned char pixel : images[i])
-        {
-            img.pixels.push_back(pixel / 255.0f);
-        }
-
-        dataset.push_back(std::move(img));
+        return false;
     }
 
-    return dataset;
-}
-
-std::vector<MNISTImage> MNISTLoader::loadTestData(const std::string &imagesPath,
-                                                  const std::string &labelsPath,
-                                                  DatasetType type,
-                                                  int maxSamples)
-{
-    return loadTrainingData(imagesPath, labelsPath, type, maxSamples);
-}
-
-int MNISTLoader::reverseInt(int i)
-{
-    unsigned char c1, c2, c3, c4;
-    c1 = i & 255;
-    c2 = (i >> 8) & 255;
-    c3 = (i >> 16) & 255;
-    c4 = (i >> 24) & 255;
-    return ((int)c1 << 24) + ((int)c2 << 16) + ((int)c3 << 8) + c4;
-}
-
-std::vector<std::vector<unsigned char>> MNISTLoader::readImages(const std::string &path, int maxSamples)
-{
-    std::ifstream file(path, std::ios::binary);
-    if (!file.is_open())
+    if (images->dimensions().size() != 3 || labels->dimensions().size() != 1)
     {
-        std::cerr << "Cannot open file: " << path << std::endl;
-        return {};
+        std::cerr << "Expected a 3-D image file and a 1-D label file: "
+                  << imagesPath << ", " << labelsPath << std::endl;
+        return false;
     }
-
-    int magic_number = 0, num_images = 0, num_rows = 0, num_cols = 0;
-
-    file.read((char *)&magic_number, sizeof(magic_number));
-    magic_number = reverseInt(magic_number);
-
-    file.read((char *)&num_images, sizeof(num_images));
-    num_images = reverseInt(num_images);
-
-    file.read((char *)&num_rows, sizeof(num_rows));
-    num_rows = reverseInt(num_rows);
-
-    file.read((char *)&num_cols, sizeof(num_cols));
-    num_cols = reverseInt(num_cols);
-
-    if (maxSamples > 0 && maxSamples < num_images)
-    {
-        num_images = maxSamples;
-    }
-
-    std::vector<std::vector<unsigned char>> images(num_images, std::vector<unsigned char>(num_rows * num_cols));
-
-    for (int i = 0; i < num_images; ++i)
+    if (images->count() != labels->count())
     {
-        file.read((char *)images[i].data(), num_rows * num_cols);
+        std::cerr << "Image and label counts differ (" << images->count() << " vs "
+                  << labels->count() << ")" << std::endl;
+        return false;
     }
-
-    file.close();
-    return images;
+    return true;
 }
 
-std::vector<int> MNISTLoader::readLabels(const std::string &path, int maxSamples)
+Dataset MNISTLoader::loadDataset(const std::string &imagesPath,
+                                 const std::string &labelsPath,
+                                 DatasetType type,
+                                 int maxSamples)
 {
-    std::ifstream file(path, std::ios::binary);
-    if (!file.is_open())
+    ScopedTimer timer(TelemetryPhase::DatasetLoad);
+    DatasetCacheKey cacheKey;
+    Dataset cached = DatasetCache::find({imagesPath, labelsPath}, maxSamples, cacheKey);
+    if (!cached.empty())
     {
-        std::cerr << "Cannot open file: " << path << std::endl;
-        return {};
+        cached.setType(type);
+        return cached;
     }
 
-    int magic_number = 0, num_labels = 0;
-
-    file.read((char *)&magic_number, sizeof(magic_number));
-    magic_number = reverseInt(magic_number);
-
-    file.read((char *)&num_labels, sizeof(num_labels));
-    num_labels = reverseInt(num_labels);
+    std::shared_ptr<IdxFile> images, labels;
+    if (!mapData(imagesPath, labelsPath, images, labels))
+    {
+        return Dataset();
+    }
 
-    if (maxSamples > 0 && maxSamples < num_labels)
+    ByteMatrix pixels = images->matrix();
+    size_t count = pixels.rows;
+    if (maxSamples > 0 && static_cast<size_t>(maxSamples) < count)
     {
-        num_labels = maxSamples;
+        count = maxSamples;
     }
 
-    std::vector<int> labels(num_labels);
-    for (int i = 0; i < num_labels; ++i)
+    // Decoded straight from the mapping into a single allocation
+    MutableDataset dataset(count, static_cast<int>(pixels.cols), type);
+    for (size_t i = 0; i < count; ++i)
     {
-        unsigned char temp = 0;
-        file.read((char *)&temp, sizeof(temp));
-        labels[i] = (int)temp;
+        dataset.setLabel(i, labels->data()[i]);
+
+        // Normalize pixels to [0,1]
+        DistanceKernels::decodeU8(pixels.row(i), 255.0f, dataset.sample(i), pixels.cols);
     }
 
-    file.close();
-    return labels;
+    DatasetCache::store(cacheKey, dataset);
+    return dataset;
+}
+
+std::vector<MNISTImage> MNISTLoader::loadTrainingData(const std::string &imagesPath,
+                                                      const std::string &labelsPath,
+                                                      DatasetType type,
+                                                      int maxSamples)
+{
+    return loadDataset(imagesPath, labelsPath, type, maxSamples).toImages();
+}
+
+std::vector<MNISTImage> MNISTLoader::loadTestData(const std::string &imagesPath,
+                                                  const std::string &labelsPath,
+                                                  DatasetType type,
+                                                  int maxSamples)
+{
+    return loadTrainingData(imagesPath, labelsPath, type, maxSamples);
 }
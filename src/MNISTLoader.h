@@ -3,17 +3,9 @@
 
 #include <vector>
 #include <string>
-
-enum class DatasetType {
-    MNIST,
-    FASHION_MNIST
-};
-
-struct MNISTImage {
-    std::vector<float> pixels;  // Normalized to [0,1]
-    int label;
-    DatasetType type;
-};
+#include <memory>
+#include "Dataset.h"
+#include "IdxFile.h"
 
 class MNISTLoader {
 public:
@@ -27,14 +19,22 @@ public:
                                                 DatasetType type = DatasetType::MNIST,
                                                 int maxSamples = -1);
 
+    // Decodes into one contiguous matrix; the vector loaders above copy out of it
+    static Dataset loadDataset(const std::string& imagesPath,
+                               const std::string& labelsPath,
+                               DatasetType type = DatasetType::MNIST,
+                               int maxSamples = -1);
+
+    // Maps an IDX image/label pair without decoding it; images->matrix() gives
+    // the raw pixels and labels->data() one label byte per image
+    static bool mapData(const std::string& imagesPath,
+                        const std::string& labelsPath,
+                        std::shared_ptr<IdxFile>& images,
+                        std::shared_ptr<IdxFile>& labels);
+
     // Get label names for different datasets
     static std::string getLabelName(int label, DatasetType type);
     static std::vector<std::string> getAllLabelNames(DatasetType type);
-
-private:
-    static int reverseInt(int i);
-    static std::vector<std::vector<unsigned char>> readImages(const std::string& path, int maxSamples);
-    static std::vector<int> readLabels(const std::string& path, int maxSamples);
 };
 
 #endif
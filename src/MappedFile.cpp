@@ -0,0 +1,41 @@
+#include "MappedFile.h"
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string& filename) {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Cannot open file: " << filename << std::endl;
+        return nullptr;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        std::cerr << "Cannot map empty or unreadable file: " << filename << std::endl;
+        close(fd);
+        return nullptr;
+    }
+
+    size_t length = static_cast<size_t>(info.st_size);
+    void* address = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps its own reference to the file
+    close(fd);
+    if (address == MAP_FAILED) {
+        std::cerr << "Cannot map file: " << filename << std::endl;
+        return nullptr;
+    }
+
+    return std::shared_ptr<MappedFile>(
+        new MappedFile(filename, static_cast<const unsigned char*>(address), length));
+}
+
+MappedFile::MappedFile(const std::string& filename, const unsigned char* bytes, size_t length)
+: filename(filename), bytes(bytes), length(length) {
+}
+
+MappedFile::~MappedFile() {
+    munmap(const_cast<unsigned char*>(bytes), length);
+}
@@ -0,0 +1,31 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+// Read-only memory mapping of a whole file. Pages are shared with every other
+// process mapping the same file and are only read from disk when touched.
+class MappedFile {
+public:
+    // Returns nullptr (and reports to std::cerr) if the file cannot be mapped
+    static std::shared_ptr<MappedFile> open(const std::string& filename);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* data() const { return bytes; }
+    size_t size() const { return length; }
+    const std::string& path() const { return filename; }
+
+private:
+    MappedFile(const std::string& filename, const unsigned char* bytes, size_t length);
+
+    std::string filename;
+    const unsigned char* bytes;
+    size_t length;
+};
+
+#endif
@@ -0,0 +1,165 @@
+#include "MetricTree.h"
+#include "DistanceKernels.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+namespace {
+// Rows per leaf; leaves are scanned linearly
+const int leafSize = 16;
+// Below this many rows a linear scan beats walking the tree
+const int minIndexedRows = 4096;
+// After this many queries the tree is abandoned if it evaluates more than
+// maxScanFraction of the rows per query on average
+const uint64_t warmupQueries = 256;
+const double maxScanFraction = 0.5;
+// Relative slack on the triangle-inequality bounds so float rounding in the
+// distances can never prune the true nearest row
+const float pruneTolerance = 1e-4f;
+}
+
+MetricTree::MetricTree()
+: rows(nullptr), stride(0), dimensions(0), numRows(0), depth(0), buildSeconds(0.0),
+indexed(false), queries(0), distanceEvaluations(0), bruteForce(false) {
+}
+
+void MetricTree::clear() {
+    rows = nullptr;
+    numRows = 0;
+    nodes.clear();
+    order.clear();
+    depth = 0;
+    buildSeconds = 0.0;
+    indexed = false;
+    queries = 0;
+    distanceEvaluations = 0;
+    bruteForce = false;
+}
+
+void MetricTree::build(const float* rowData, size_t rowStride, size_t n, int count, unsigned int seed) {
+    clear();
+    rows = rowData;
+    stride = rowStride;
+    dimensions = n;
+    numRows = count;
+    indexed = count >= minIndexedRows;
+    bruteForce = !indexed;
+    if (!indexed) return;
+
+    auto start = std::chrono::steady_clock::now();
+
+    order.resize(count);
+    for (int i = 0; i < count; ++i) {
+        order[i] = i;
+    }
+    nodes.reserve(2 * count / leafSize + 1);
+
+    std::vector<float> distances(count);
+    std::mt19937 random(seed);
+    buildNode(0, count, 1, distances, random);
+
+    buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int MetricTree::buildNode(int begin, int end, int level, std::vector<float>& distances, std::mt19937& random) {
+    int nodeIndex = static_cast<int>(nodes.size());
+    nodes.push_back(Node());
+    depth = std::max(depth, level);
+
+    if (end - begin <= leafSize) {
+        nodes[nodeIndex] = {-1, 0.0f, -1, -1, begin, end};
+        return nodeIndex;
+    }
+
+    // Random vantage row moved to the front, the rest split at the median distance
+    std::uniform_int_distribution<int> pick(begin, end - 1);
+    std::swap(order[begin], order[pick(random)]);
+    int vantage = order[begin];
+
+    for (int i = begin + 1; i < end; ++i) {
+        distances[order[i]] = std::sqrt(DistanceKernels::squaredL2(row(vantage), row(order[i]), dimensions));
+    }
+
+    int middle = begin + 1 + (end - begin - 1) / 2;
+    std::nth_element(order.begin() + begin + 1, order.begin() + middle, order.begin() + end,
+                     [&](int a, int b) { return distances[a] < distances[b]; });
+    float threshold = distances[order[middle]];
+
+    int inside = buildNode(begin + 1, middle, level + 1, distances, random);
+    int outside = buildNode(middle, end, level + 1, distances, random);
+    nodes[nodeIndex] = {vantage, threshold, inside, outside, 0, 0};
+    return nodeIndex;
+}
+
+void MetricTree::offer(Candidate& best, int index, float squaredDistance) const {
+    if (squaredDistance < best.squaredDistance ||
+        (squaredDistance == best.squaredDistance && index < best.index)) {
+        best.squaredDistance = squaredDistance;
+        best.radius = std::sqrt(squaredDistance) * (1.0f + pruneTolerance);
+        best.index = index;
+    }
+}
+
+void MetricTree::search(int nodeIndex, const float* x, Candidate& best, uint64_t& evaluations) const {
+    const Node& node = nodes[nodeIndex];
+
+    if (node.vantage < 0) {
+        for (int i = node.begin; i < node.end; ++i) {
+            offer(best, order[i], DistanceKernels::squaredL2(x, row(order[i]), dimensions));
+        }
+        evaluations += node.end - node.begin;
+        return;
+    }
+
+    float squaredDistance = DistanceKernels::squaredL2(x, row(node.vantage), dimensions);
+    evaluations++;
+    offer(best, node.vantage, squaredDistance);
+    float distance = std::sqrt(squaredDistance);
+    float slack = distance * pruneTolerance;
+
+    // Nearer side first; the other side only if the ball around x reaches across
+    if (distance < node.threshold) {
+        search(node.inside, x, best, evaluations);
+        if (distance + best.radius + slack >= node.threshold) {
+            search(node.outside, x, best, evaluations);
+        }
+    } else {
+        search(node.outside, x, best, evaluations);
+        if (distance - best.radius - slack <= node.threshold) {
+            search(node.inside, x, best, evaluations);
+        }
+    }
+}
+
+int MetricTree::nearest(const float* x, float& squaredDistance) const {
+    if (!indexed || bruteForce.load(std::memory_order_relaxed)) {
+        return DistanceKernels::argminSquaredL2(x, rows, stride, dimensions, 0, numRows, squaredDistance);
+    }
+
+    Candidate best = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), numRows};
+    uint64_t evaluations = 0;
+    search(0, x, best, evaluations);
+
+    uint64_t queryCount = queries.fetch_add(1, std::memory_order_relaxed) + 1;
+    uint64_t totalEvaluations = distanceEvaluations.fetch_add(evaluations, std::memory_order_relaxed) + evaluations;
+    if (queryCount == warmupQueries &&
+        static_cast<double>(totalEvaluations) / queryCount > maxScanFraction * numRows) {
+        bruteForce.store(true, std::memory_order_relaxed);
+    }
+
+    squaredDistance = best.squaredDistance;
+    return best.index;
+}
+
+MetricTreeStats MetricTree::getStats() const {
+    MetricTreeStats stats;
+    stats.rows = numRows;
+    stats.nodes = static_cast<int>(nodes.size());
+    stats.depth = depth;
+    stats.buildSeconds = buildSeconds;
+    stats.queries = queries.load();
+    stats.distanceEvaluations = distanceEvaluations.load();
+    stats.bruteForce = bruteForce.load();
+    return stats;
+}
@@ -0,0 +1,81 @@
+#ifndef METRICTREE_H
+#define METRICTREE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+struct MetricTreeStats {
+    int rows;
+    int nodes;
+    int depth;
+    double buildSeconds;
+    uint64_t queries;
+    uint64_t distanceEvaluations;
+    bool bruteForce;  // The tree was skipped or stopped paying off
+
+    // Distance computations per query as a fraction of a linear scan
+    double scanFraction() const {
+        return queries == 0 || rows == 0 ? 0.0
+                                         : static_cast<double>(distanceEvaluations) / queries / rows;
+    }
+};
+
+// Exact nearest-neighbor index (vantage-point tree) over rows of a weight matrix.
+// The rows are referenced, not copied, and must outlive the tree unchanged.
+// Queries are thread-safe. Small matrices, and trees that stop pruning once
+// queries arrive, fall back to a linear scan.
+class MetricTree {
+public:
+    MetricTree();
+
+    MetricTree(const MetricTree&) = delete;
+    MetricTree& operator=(const MetricTree&) = delete;
+
+    void build(const float* rows, size_t stride, size_t n, int numRows, unsigned int seed = 1);
+    void clear();
+    bool empty() const { return rows == nullptr; }
+
+    // Nearest row to x (squared L2, lowest index on ties)
+    int nearest(const float* x, float& squaredDistance) const;
+
+    MetricTreeStats getStats() const;
+
+private:
+    struct Node {
+        int vantage;      // Row index, or -1 for a leaf
+        float threshold;  // Median distance from the vantage row
+        int inside;       // Child with distances <= threshold
+        int outside;      // Child with distances >= threshold
+        int begin, end;   // Leaf rows in `order`
+    };
+
+    const float* rows;
+    size_t stride;
+    size_t dimensions;
+    int numRows;
+    std::vector<Node> nodes;
+    std::vector<int> order;
+    int depth;
+    double buildSeconds;
+    bool indexed;
+
+    mutable std::atomic<uint64_t> queries;
+    mutable std::atomic<uint64_t> distanceEvaluations;
+    mutable std::atomic<bool> bruteForce;
+
+    struct Candidate {
+        float squaredDistance;
+        float radius;  // sqrt(squaredDistance) widened by the pruning tolerance
+        int index;
+    };
+
+    int buildNode(int begin, int end, int level, std::vector<float>& distances, std::mt19937& random);
+    void search(int node, const float* x, Candidate& best, uint64_t& evaluations) const;
+    void offer(Candidate& best, int index, float squaredDistance) const;
+    const float* row(int index) const { return rows + index * stride; }
+};
+
+#endif
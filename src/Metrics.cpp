@@ -1,4 +1,5 @@
 #include "Metrics.h"
+#include "Telemetry.h"
 #include <iostream>
 #include <iomanip>
 #include <fstream>
@@ -62,6 +63,20 @@ float Metrics::calculateAccuracy(const std::vector<ClassificationResult> &result
     return static_cast<float>(correct) / results.size();
 }
 
+float Metrics::calculateQuantizationError(const std::vector<SampleAssignment> &assignments)
+{
+    if (assignments.empty())
+        return 0.0f;
+
+    double total = 0.0;
+    for (const auto &assignment : assignments)
+    {
+        total += std::sqrt(assignment.squaredDistance);
+    }
+
+    return static_cast<float>(total / assignments.size());
+}
+
 std::vector<std::vector<int>> Metrics::calculateConfusionMatrix(
     const std::vector<ClassificationResult> &results,
     int numClasses)
@@ -226,4 +241,15 @@ void Metrics::saveReportToFile(const MetricsReport &report,
 
     file.close();
     std::cout << "Report saved to: " << filename << std::endl;
+
+    // Timings and throughput of the run that produced the report, e.g. report.txt -> report_telemetry.json
+    size_t extension = filename.find_last_of('.');
+    size_t directory = filename.find_last_of("/\\");
+    std::string stem = (extension != std::string::npos && (directory == std::string::npos || extension > directory))
+                           ? filename.substr(0, extension)
+                           : filename;
+    if (Telemetry::saveJson(stem + "_telemetry.json"))
+    {
+        std::cout << "Telemetry saved to: " << stem << "_telemetry.json" << std::endl;
+    }
 }
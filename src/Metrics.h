@@ -4,6 +4,7 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <cstdint>
 #include "MNISTLoader.h"
 
 struct ClassificationResult {
@@ -12,6 +13,12 @@ struct ClassificationResult {
     float confidence;  // Distance to BMU (lower = more confident)
 };
 
+// BMU of one sample as cached by the post-training labeling pass
+struct SampleAssignment {
+    uint32_t bmu;
+    float squaredDistance;
+};
+
 struct MetricsReport {
     float accuracy;
     std::vector<std::vector<int>> confusionMatrix;
@@ -41,6 +48,9 @@ public:
 
     static float calculateAccuracy(const std::vector<ClassificationResult>& results);
 
+    // Mean distance between samples and their BMU weights
+    static float calculateQuantizationError(const std::vector<SampleAssignment>& assignments);
+
     static std::vector<std::vector<int>> calculateConfusionMatrix(
         const std::vector<ClassificationResult>& results,
         int numClasses
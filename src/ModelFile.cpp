@@ -0,0 +1,190 @@
+#include "ModelFile.h"
+#include "KohonenNetwork.h"
+#include "MappedFile.h"
+#include <atomic>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+namespace {
+const char modelMagic[8] = {'K', 'S', 'O', 'M', '3', 'D', '\0', '\0'};
+const uint64_t sectionAlignment = 64;
+
+uint64_t alignSection(uint64_t offset) {
+    return (offset + sectionAlignment - 1) & ~(sectionAlignment - 1);
+}
+
+bool isLittleEndian() {
+    const uint16_t probe = 1;
+    unsigned char first;
+    std::memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+void writeSection(std::ofstream& file, uint64_t offset, const void* data, size_t bytes) {
+    static const char zeros[sectionAlignment] = {};
+    uint64_t position = static_cast<uint64_t>(file.tellp());
+    file.write(zeros, static_cast<std::streamsize>(offset - position));
+    file.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+}
+}
+
+bool ModelFile::save(const KohonenNetwork& network, const std::string& filename) {
+    if (!isLittleEndian()) {
+        std::cerr << "Model files can only be written on little-endian hosts" << std::endl;
+        return false;
+    }
+
+    uint64_t numNeurons = static_cast<uint64_t>(network.numNeurons);
+
+    ModelFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, modelMagic, sizeof(modelMagic));
+    header.version = currentVersion;
+    header.headerSize = sizeof(ModelFileHeader);
+    header.width = network.width;
+    header.height = network.height;
+    header.depth = network.depth;
+    header.inputSize = network.inputSize;
+    header.weightStride = static_cast<uint32_t>(network.weightStride);
+    header.datasetType = static_cast<int32_t>(network.currentDatasetType);
+    header.classCount = network.classCount;
+
+    header.weightsOffset = alignSection(sizeof(ModelFileHeader));
+    header.prototypeImagesOffset = alignSection(header.weightsOffset + numNeurons * network.weightStride * sizeof(float));
+    header.dominantClassesOffset = alignSection(header.prototypeImagesOffset + numNeurons * network.inputSize * sizeof(float));
+    header.prototypeIndicesOffset = alignSection(header.dominantClassesOffset + numNeurons * sizeof(int32_t));
+    header.colorsOffset = alignSection(header.prototypeIndicesOffset + numNeurons * sizeof(int32_t));
+    header.fileSize = header.colorsOffset + numNeurons * 3 * sizeof(float);
+
+    // Neurons that were never labeled have no prototype
+    std::vector<int32_t> prototypeIndices(numNeurons, -1);
+    if (!network.prototypeIndices.empty()) {
+        std::copy(network.prototypeIndices.begin(), network.prototypeIndices.end(), prototypeIndices.begin());
+    }
+
+    // Written beside the target and renamed over it: processes that have the old
+    // file mapped (including this network) keep reading the old pages. The name is
+    // unique per process and call so concurrent savers never share a temporary.
+    static std::atomic<unsigned> sequence(0);
+    std::string temporary = filename + ".tmp" + std::to_string(getpid()) + "." + std::to_string(sequence++);
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Cannot create model file: " << temporary << std::endl;
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writeSection(file, header.weightsOffset, network.weightData,
+                 numNeurons * network.weightStride * sizeof(float));
+    writeSection(file, header.prototypeImagesOffset, network.prototypeData,
+                 numNeurons * network.inputSize * sizeof(float));
+    writeSection(file, header.dominantClassesOffset, network.dominantClasses.data(),
+                 numNeurons * sizeof(int32_t));
+    writeSection(file, header.prototypeIndicesOffset, prototypeIndices.data(), numNeurons * sizeof(int32_t));
+    writeSection(file, header.colorsOffset, network.colors.data(), numNeurons * 3 * sizeof(float));
+
+    file.close();
+    if (!file.good() || std::rename(temporary.c_str(), filename.c_str()) != 0) {
+        std::cerr << "Failed writing model file: " << filename << std::endl;
+        std::remove(temporary.c_str());
+        return false;
+    }
+
+    std::cout << "Saved model to " << filename << " (" << (header.fileSize >> 10) << " KiB)" << std::endl;
+    return true;
+}
+
+std::unique_ptr<KohonenNetwork> ModelFile::load(const std::string& filename) {
+    std::shared_ptr<MappedFile> mapping = MappedFile::open(filename);
+    if (!mapping) return nullptr;
+
+    ModelFileHeader header;
+    if (mapping->size() < sizeof(header)) {
+        std::cerr << "Truncated model file: " << filename << std::endl;
+        return nullptr;
+    }
+    std::memcpy(&header, mapping->data(), sizeof(header));
+
+    if (std::memcmp(header.magic, modelMagic, sizeof(modelMagic)) != 0 || !isLittleEndian()) {
+        std::cerr << "Not a model file: " << filename << std::endl;
+        return nullptr;
+    }
+    if (header.version != currentVersion || header.headerSize != sizeof(ModelFileHeader)) {
+        std::cerr << "Unsupported model file version " << header.version << ": " << filename << std::endl;
+        return nullptr;
+    }
+    if (header.width <= 0 || header.height <= 0 || header.depth <= 0 || header.inputSize <= 0 ||
+        header.classCount < 0 || header.fileSize > mapping->size()) {
+        std::cerr << "Corrupt model file: " << filename << std::endl;
+        return nullptr;
+    }
+
+    // KohonenNetwork counts neurons in an int
+    uint64_t numNeurons = static_cast<uint64_t>(header.width) * header.height * header.depth;
+    if (numNeurons > static_cast<uint64_t>(INT_MAX)) {
+        std::cerr << "Model lattice " << header.width << "x" << header.height << "x" << header.depth
+                  << " is too large: " << filename << std::endl;
+        return nullptr;
+    }
+    uint32_t expectedStride = (static_cast<uint32_t>(header.inputSize) + 15) & ~15u;
+    if (header.weightStride != expectedStride) {
+        std::cerr << "Model weight stride " << header.weightStride << " does not match this build: "
+                  << filename << std::endl;
+        return nullptr;
+    }
+
+    // Offset, values per neuron and value size of each section. Sizes are checked
+    // by division and ends by subtraction so crafted fields cannot overflow.
+    const uint64_t sections[][3] = {
+        {header.weightsOffset, header.weightStride, sizeof(float)},
+        {header.prototypeImagesOffset, static_cast<uint64_t>(header.inputSize), sizeof(float)},
+        {header.dominantClassesOffset, 1, sizeof(int32_t)},
+        {header.prototypeIndicesOffset, 1, sizeof(int32_t)},
+        {header.colorsOffset, 3, sizeof(float)},
+    };
+    for (const auto& section : sections) {
+        bool fits = section[1] <= header.fileSize / section[2] / numNeurons;
+        uint64_t bytes = fits ? numNeurons * section[1] * section[2] : 0;
+        if (!fits || section[0] % sectionAlignment != 0 || section[0] > header.fileSize ||
+            bytes > header.fileSize - section[0]) {
+            std::cerr << "Corrupt model file: " << filename << std::endl;
+            return nullptr;
+        }
+    }
+
+    const unsigned char* base = mapping->data();
+    const int32_t* dominantClasses = reinterpret_cast<const int32_t*>(base + header.dominantClassesOffset);
+    for (uint64_t n = 0; n < numNeurons; ++n) {
+        if (dominantClasses[n] < -1 || dominantClasses[n] >= header.classCount) {
+            std::cerr << "Corrupt model file: neuron " << n << " has class " << dominantClasses[n]
+                      << " of " << header.classCount << ": " << filename << std::endl;
+            return nullptr;
+        }
+    }
+
+    std::unique_ptr<KohonenNetwork> network(
+        new KohonenNetwork(header.width, header.height, header.depth, header.inputSize, false));
+
+    const int32_t* prototypeIndices = reinterpret_cast<const int32_t*>(base + header.prototypeIndicesOffset);
+    const float* colors = reinterpret_cast<const float*>(base + header.colorsOffset);
+
+    // Per-neuron labels and colors are a few bytes per neuron and stay mutable
+    network->dominantClasses.assign(dominantClasses, dominantClasses + numNeurons);
+    network->prototypeIndices.assign(prototypeIndices, prototypeIndices + numNeurons);
+    network->colors.assign(colors, colors + numNeurons * 3);
+    network->classCount = header.classCount;
+    network->currentDatasetType = static_cast<DatasetType>(header.datasetType);
+
+    network->attachMappedModel(mapping,
+                               reinterpret_cast<const float*>(base + header.weightsOffset),
+                               reinterpret_cast<const float*>(base + header.prototypeImagesOffset));
+
+    std::cout << "Mapped model " << filename << ": " << header.width << "x" << header.height << "x"
+              << header.depth << " neurons, input size " << header.inputSize << std::endl;
+    return network;
+}
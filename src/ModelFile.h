@@ -0,0 +1,41 @@
+#ifndef MODELFILE_H
+#define MODELFILE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+class KohonenNetwork;
+
+// On-disk layout of a trained network. All integers are little-endian, every
+// section starts on a 64-byte boundary and the weight rows keep the in-memory
+// stride, so a mapped file can be used in place without any copy.
+struct ModelFileHeader {
+    char magic[8];            // "KSOM3D\0\0"
+    uint32_t version;
+    uint32_t headerSize;
+    int32_t width, height, depth;
+    int32_t inputSize;
+    uint32_t weightStride;    // Floats per weight row
+    int32_t datasetType;
+    int32_t classCount;
+    uint32_t reserved;
+    uint64_t weightsOffset;          // float[numNeurons * weightStride]
+    uint64_t prototypeImagesOffset;  // float[numNeurons * inputSize]
+    uint64_t dominantClassesOffset;  // int32[numNeurons]
+    uint64_t prototypeIndicesOffset; // int32[numNeurons]
+    uint64_t colorsOffset;           // float[numNeurons * 3]
+    uint64_t fileSize;
+};
+
+class ModelFile {
+public:
+    static const uint32_t currentVersion = 1;
+
+    static bool save(const KohonenNetwork& network, const std::string& filename);
+    // Maps the file read-only: weights and prototype images are served straight
+    // from the shared page cache. Returns nullptr on any format error.
+    static std::unique_ptr<KohonenNetwork> load(const std::string& filename);
+};
+
+#endif
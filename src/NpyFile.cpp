@@ -0,0 +1,270 @@
+#include "NpyFile.h"
+#include "DistanceKernels.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+const size_t magicSize = 6;
+const size_t maxRank = 32;  // NPY_MAXDIMS
+
+bool hostLittleEndian() {
+    const uint16_t probe = 1;
+    return *reinterpret_cast<const unsigned char*>(&probe) == 1;
+}
+
+// Value of a key in the header dict, up to the next top-level comma or brace
+std::string headerValue(const std::string& header, const std::string& key) {
+    size_t keyPos = header.find("'" + key + "'");
+    if (keyPos == std::string::npos) keyPos = header.find("\"" + key + "\"");
+    if (keyPos == std::string::npos) return "";
+
+    size_t colon = header.find(':', keyPos + key.size() + 2);
+    if (colon == std::string::npos) return "";
+    size_t begin = header.find_first_not_of(" \t", colon + 1);
+    if (begin == std::string::npos) return "";
+
+    size_t end = header[begin] == '(' ? header.find(')', begin) + 1 : header.find_first_of(",}", begin);
+    if (end == std::string::npos || end == 0) return "";
+    std::string value = header.substr(begin, end - begin);
+    value.erase(value.find_last_not_of(" \t") + 1);
+    return value;
+}
+
+bool parseShape(const std::string& text, std::vector<size_t>& shape) {
+    if (text.size() < 2 || text.front() != '(' || text.back() != ')') return false;
+
+    size_t pos = 1;
+    while (pos < text.size() - 1) {
+        size_t comma = text.find(',', pos);
+        if (comma == std::string::npos) comma = text.size() - 1;
+        std::string item = text.substr(pos, comma - pos);
+        item.erase(0, item.find_first_not_of(" \t"));
+        item.erase(item.find_last_not_of(" \t") + 1);
+        if (!item.empty()) {
+            if (item.find_first_not_of("0123456789") != std::string::npos) return false;
+            shape.push_back(std::stoull(item));
+        }
+        pos = comma + 1;
+    }
+    return shape.size() <= maxRank;
+}
+
+template <typename T>
+float loadElement(const unsigned char* bytes, bool swap) {
+    unsigned char ordered[sizeof(T)];
+    if (swap) {
+        std::reverse_copy(bytes, bytes + sizeof(T), ordered);
+    } else {
+        std::memcpy(ordered, bytes, sizeof(T));
+    }
+    T value;
+    std::memcpy(&value, ordered, sizeof(T));
+    return static_cast<float>(value);
+}
+
+// Elements base[offsets[j]] (or base[j] without offsets) of a row
+template <typename T>
+void convertRow(const unsigned char* base, const size_t* offsets, size_t n, bool swap, float divisor, float* out) {
+    for (size_t j = 0; j < n; ++j) {
+        size_t element = offsets ? offsets[j] : j;
+        out[j] = loadElement<T>(base + element * sizeof(T), swap) / divisor;
+    }
+}
+}
+
+std::shared_ptr<NpyFile> NpyFile::open(const std::string& filename) {
+    std::shared_ptr<MappedFile> mapped = MappedFile::open(filename);
+    if (!mapped) return nullptr;
+
+    // Magic, version, then a little-endian header length: 2 bytes in version 1,
+    // 4 bytes in versions 2 and 3 (3 only allows UTF-8 in the dict)
+    const unsigned char* bytes = mapped->data();
+    size_t size = mapped->size();
+    if (size < 10 || std::memcmp(bytes, "\x93NUMPY", magicSize) != 0) {
+        std::cerr << "Not an NPY file: " << filename << std::endl;
+        return nullptr;
+    }
+
+    unsigned char major = bytes[6];
+    size_t headerStart, headerLength;
+    if (major == 1) {
+        headerStart = 10;
+        headerLength = bytes[8] | (static_cast<size_t>(bytes[9]) << 8);
+    } else if (major == 2 || major == 3) {
+        headerStart = 12;
+        headerLength = size < 12 ? 0 : bytes[8] | (static_cast<size_t>(bytes[9]) << 8) |
+                       (static_cast<size_t>(bytes[10]) << 16) | (static_cast<size_t>(bytes[11]) << 24);
+    } else {
+        std::cerr << "Unsupported NPY format version " << static_cast<int>(major) << ": " << filename << std::endl;
+        return nullptr;
+    }
+    if (size < headerStart || size - headerStart < headerLength) {
+        std::cerr << "Truncated NPY header: " << filename << std::endl;
+        return nullptr;
+    }
+
+    std::shared_ptr<NpyFile> npy(new NpyFile(mapped, bytes + headerStart + headerLength));
+    std::string header(reinterpret_cast<const char*>(bytes + headerStart), headerLength);
+
+    // descr: byte order ('<', '>', '|' or '='), kind and item size, e.g. '<f4'
+    std::string descr = headerValue(header, "descr");
+    if (descr.size() < 4 || (descr.front() != '\'' && descr.front() != '"') || descr.back() != descr.front()) {
+        std::cerr << "Unsupported NPY dtype " << descr << " (only simple numeric types): " << filename << std::endl;
+        return nullptr;
+    }
+    npy->typeDescr = descr.substr(1, descr.size() - 2);
+    char order = npy->typeDescr[0];
+    npy->kind = npy->typeDescr[1];
+    npy->itemBytes = std::strtoul(npy->typeDescr.c_str() + 2, nullptr, 10);
+
+    bool integer = (npy->kind == 'i' || npy->kind == 'u') &&
+                   (npy->itemBytes == 1 || npy->itemBytes == 2 || npy->itemBytes == 4 || npy->itemBytes == 8);
+    bool floating = npy->kind == 'f' && (npy->itemBytes == 4 || npy->itemBytes == 8);
+    if (std::string("<>|=").find(order) == std::string::npos || !(integer || floating) ||
+        npy->typeDescr.find_first_not_of("0123456789", 2) != std::string::npos) {
+        std::cerr << "Unsupported NPY dtype " << npy->typeDescr << ": " << filename << std::endl;
+        return nullptr;
+    }
+    npy->swapBytes = npy->itemBytes > 1 && ((order == '<' && !hostLittleEndian()) ||
+                                             (order == '>' && hostLittleEndian()));
+
+    std::string fortran = headerValue(header, "fortran_order");
+    if (fortran != "True" && fortran != "False") {
+        std::cerr << "Missing fortran_order in NPY header: " << filename << std::endl;
+        return nullptr;
+    }
+    npy->fortranOrder = fortran == "True";
+
+    if (!parseShape(headerValue(header, "shape"), npy->dims)) {
+        std::cerr << "Invalid shape in NPY header: " << filename << std::endl;
+        return nullptr;
+    }
+    npy->rows = npy->dims.empty() ? 1 : npy->dims[0];
+    npy->rowElements = 1;
+    for (size_t d = 1; d < npy->dims.size(); ++d) {
+        npy->rowElements *= npy->dims[d];
+    }
+
+    size_t available = (size - headerStart - headerLength) / npy->itemBytes;
+    if (npy->rowElements != 0 && available / npy->rowElements < npy->rows) {
+        std::cerr << "NPY payload is shorter than its header declares: " << filename << std::endl;
+        return nullptr;
+    }
+
+    // Column-major over the whole shape: element (r, i1, ..., ik) sits at
+    // r + rows * (i1 + d1 * (i2 + ...)); j below enumerates (i1, ..., ik) in C order
+    if (!npy->rowsContiguous()) {
+        npy->columnOffsets.resize(npy->rowElements);
+        for (size_t j = 0; j < npy->rowElements; ++j) {
+            size_t remainder = j;
+            size_t offset = 0;
+            size_t scale = npy->rows;
+            std::vector<size_t> index(npy->dims.size());
+            for (size_t d = npy->dims.size() - 1; d >= 1; --d) {
+                index[d] = remainder % npy->dims[d];
+                remainder /= npy->dims[d];
+            }
+            for (size_t d = 1; d < npy->dims.size(); ++d) {
+                offset += index[d] * scale;
+                scale *= npy->dims[d];
+            }
+            npy->columnOffsets[j] = offset;
+        }
+    }
+    return npy;
+}
+
+NpyFile::NpyFile(std::shared_ptr<MappedFile> file, const unsigned char* payload)
+: file(file), payload(payload), kind(0), itemBytes(1), swapBytes(false), fortranOrder(false),
+rows(0), rowElements(0) {
+}
+
+ByteMatrix NpyFile::matrix() const {
+    if (kind != 'u' || itemBytes != 1 || !rowsContiguous()) return {nullptr, 0, 0};
+    return {payload, rows, rowElements};
+}
+
+void NpyFile::readRows(size_t begin, size_t end, float* out, size_t outStride, float divisor) const {
+    const size_t* offsets = rowsContiguous() ? nullptr : columnOffsets.data();
+    for (size_t r = begin; r < end; ++r) {
+        float* row = out + (r - begin) * outStride;
+        // Contiguous rows start at their own offset; Fortran rows are gathered
+        // from the column offsets, relative to element r
+        const unsigned char* base = payload + (offsets ? r : r * rowElements) * itemBytes;
+
+        if (!offsets && kind == 'u' && itemBytes == 1) {
+            DistanceKernels::decodeU8(base, divisor, row, rowElements);
+        } else if (!offsets && kind == 'f' && itemBytes == 4 && !swapBytes && divisor == 1.0f) {
+            std::memcpy(row, base, rowElements * sizeof(float));
+        } else if (kind == 'f') {
+            if (itemBytes == 4) convertRow<float>(base, offsets, rowElements, swapBytes, divisor, row);
+            else convertRow<double>(base, offsets, rowElements, swapBytes, divisor, row);
+        } else if (kind == 'i') {
+            switch (itemBytes) {
+                case 1: convertRow<int8_t>(base, offsets, rowElements, swapBytes, divisor, row); break;
+                case 2: convertRow<int16_t>(base, offsets, rowElements, swapBytes, divisor, row); break;
+                case 4: convertRow<int32_t>(base, offsets, rowElements, swapBytes, divisor, row); break;
+                default: convertRow<int64_t>(base, offsets, rowElements, swapBytes, divisor, row); break;
+            }
+        } else {
+            switch (itemBytes) {
+                case 1: convertRow<uint8_t>(base, offsets, rowElements, swapBytes, divisor, row); break;
+                case 2: convertRow<uint16_t>(base, offsets, rowElements, swapBytes, divisor, row); break;
+                case 4: convertRow<uint32_t>(base, offsets, rowElements, swapBytes, divisor, row); break;
+                default: convertRow<uint64_t>(base, offsets, rowElements, swapBytes, divisor, row); break;
+            }
+        }
+    }
+}
+
+std::shared_ptr<NpyChunkReader> NpyChunkReader::open(const std::string& samplesPath, const std::string& labelsPath,
+                                                     size_t chunkRows, float divisor, DatasetType type) {
+    std::shared_ptr<NpyFile> samples = NpyFile::open(samplesPath);
+    std::shared_ptr<NpyFile> labels = labelsPath.empty() ? nullptr : NpyFile::open(labelsPath);
+    if (!samples || (!labelsPath.empty() && !labels)) return nullptr;
+
+    if (samples->shape().empty() || (labels && (labels->shape().size() != 1 || labels->count() != samples->count()))) {
+        std::cerr << "Expected a sample array and a 1-D label array of the same length: "
+                  << samplesPath << ", " << labelsPath << std::endl;
+        return nullptr;
+    }
+    return std::shared_ptr<NpyChunkReader>(new NpyChunkReader(samples, labels, std::max<size_t>(chunkRows, 1),
+                                                              divisor, type));
+}
+
+NpyChunkReader::NpyChunkReader(std::shared_ptr<NpyFile> samples, std::shared_ptr<NpyFile> labels,
+                               size_t chunkRows, float divisor, DatasetType type)
+: samples(samples), labels(labels), chunkRows(std::min(chunkRows, samples->count())), divisor(divisor),
+buffer(std::min(chunkRows, samples->count()), static_cast<int>(samples->rowSize()), type), position(0),
+labelBuffer(buffer.size()) {
+}
+
+Dataset NpyChunkReader::read(size_t begin, size_t end) {
+    end = std::min(end, std::min(size(), begin + chunkRows));
+    begin = std::min(begin, end);
+    MutableDataset view = buffer.slice(0, end - begin);
+    if (view.empty()) return view;
+
+    samples->readRows(begin, end, view.sample(0), view.getStride(), divisor);
+    if (labels) labels->readRows(begin, end, labelBuffer.data(), 1);
+    for (size_t i = 0; i < view.size(); ++i) {
+        view.setLabel(i, labels ? static_cast<int>(labelBuffer[i]) : -1);
+    }
+    return view;
+}
+
+bool NpyChunkReader::next() {
+    if (position >= size()) {
+        current = Dataset();
+        return false;
+    }
+    current = read(position, position + chunkRows);
+    position += current.size();
+    return true;
+}
+
+void NpyChunkReader::rewind() {
+    position = 0;
+    current = Dataset();
+}
@@ -0,0 +1,116 @@
+#ifndef NPYFILE_H
+#define NPYFILE_H
+
+#include "Dataset.h"
+#include "IdxFile.h"
+#include "MappedFile.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// NPY array (format versions 1.0 to 3.0) mapped read-only. The header is parsed
+// and checked against the file size once; elements are then read in place, so
+// opening costs the same whatever the array size and only rows that are read
+// are ever paged in.
+class NpyFile {
+public:
+    // Returns nullptr (and reports to std::cerr) unless the file is a complete
+    // array of a supported dtype: (u)int8 to (u)int64, float32 or float64, in
+    // either byte order and either memory order
+    static std::shared_ptr<NpyFile> open(const std::string& filename);
+
+    const std::vector<size_t>& shape() const { return dims; }
+    const std::string& descr() const { return typeDescr; }
+    bool isFortranOrder() const { return fortranOrder; }
+    // Rows along the first axis (1 for a 0-d array) and elements per row
+    size_t count() const { return rows; }
+    size_t rowSize() const { return rowElements; }
+    size_t itemSize() const { return itemBytes; }
+    const unsigned char* data() const { return payload; }
+
+    // The payload in place as T: null unless T is exactly the stored element
+    // type, in native byte order, with each row contiguous
+    template <typename T>
+    const T* view() const;
+    // uint8 arrays as a count x rowSize matrix read in place; data is null for
+    // any other dtype or layout
+    ByteMatrix matrix() const;
+
+    // Rows [begin, end) as floats divided by divisor, each row in C order and
+    // `outStride` floats after the previous one. Byte swapping and Fortran order
+    // are handled here; uint8 rows go through the SIMD decoder and native float32
+    // rows are copied as they are.
+    void readRows(size_t begin, size_t end, float* out, size_t outStride, float divisor = 1.0f) const;
+
+private:
+    NpyFile(std::shared_ptr<MappedFile> file, const unsigned char* payload);
+
+    bool rowsContiguous() const { return !fortranOrder || rowElements <= 1; }
+
+    std::shared_ptr<MappedFile> file;
+    const unsigned char* payload;
+    std::vector<size_t> dims;
+    std::string typeDescr;
+    char kind;  // 'i', 'u' or 'f'
+    size_t itemBytes;
+    bool swapBytes;
+    bool fortranOrder;
+    size_t rows;
+    size_t rowElements;
+    std::vector<size_t> columnOffsets;  // Fortran order: element j of row r is element r + columnOffsets[j]
+};
+
+template <typename T>
+const T* NpyFile::view() const {
+    char expected = std::is_floating_point<T>::value ? 'f' : std::is_signed<T>::value ? 'i' : 'u';
+    if (kind != expected || itemBytes != sizeof(T) || swapBytes || !rowsContiguous() ||
+        reinterpret_cast<uintptr_t>(payload) % alignof(T) != 0) {
+        return nullptr;
+    }
+    return reinterpret_cast<const T*>(payload);
+}
+
+// Walks an NPY sample array, and optionally a 1-D label array of the same
+// length, a chunk of rows at a time. Every chunk is decoded into the same
+// buffer, so memory use is one chunk of floats however large the files are.
+class NpyChunkReader {
+public:
+    // labelsPath may be empty (every label is then -1). Returns nullptr (and
+    // reports to std::cerr) if a file cannot be opened or the lengths differ.
+    static std::shared_ptr<NpyChunkReader> open(const std::string& samplesPath, const std::string& labelsPath,
+                                                size_t chunkRows, float divisor = 1.0f,
+                                                DatasetType type = DatasetType::MNIST);
+
+    size_t size() const { return samples->count(); }
+    int getInputSize() const { return static_cast<int>(samples->rowSize()); }
+    size_t chunkSize() const { return chunkRows; }
+
+    // Samples [begin, end), at most chunkSize() of them; the view is
+    // overwritten by the next read
+    Dataset read(size_t begin, size_t end);
+
+    // Sequential iteration: next() decodes the following chunk into chunk()
+    // and returns false once the array is exhausted
+    bool next();
+    const Dataset& chunk() const { return current; }
+    size_t chunkBegin() const { return position - current.size(); }
+    void rewind();
+
+private:
+    NpyChunkReader(std::shared_ptr<NpyFile> samples, std::shared_ptr<NpyFile> labels,
+                   size_t chunkRows, float divisor, DatasetType type);
+
+    std::shared_ptr<NpyFile> samples;
+    std::shared_ptr<NpyFile> labels;
+    size_t chunkRows;
+    float divisor;
+    MutableDataset buffer;
+    Dataset current;
+    size_t position;
+    std::vector<float> labelBuffer;
+};
+
+#endif
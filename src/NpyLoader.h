@@ -3,12 +3,13 @@
 
 #include <vector>
 #include <string>
+#include "Dataset.h"
 
 struct NpyArray {
-    std::vector<float> data;
+    std::vector<float> data;  // Always in C order
     std::vector<size_t> shape;
     std::string dtype;
-    bool fortran_order;
+    bool fortran_order;  // Layout of the file the data was read from
 
     size_t size() const {
         size_t total = 1;
@@ -19,14 +20,15 @@ struct NpyArray {
     }
 };
 
+// Whole-array loading on top of NpyFile; arrays too large to decode at once
+// can be read a chunk at a time with NpyChunkReader instead
 class NpyLoader {
 public:
     static NpyArray load(const std::string& filename);
-
-private:
-    static void parseHeader(const std::string& header, NpyArray& array);
-    static std::string trim(const std::string& str);
-    static std::vector<size_t> parseShape(const std::string& shapeStr);
+    // Images of shape (count, ...) and labels of shape (count,); uint8 pixels
+    // are scaled to [0,1], other dtypes are taken as already normalized
+    static Dataset loadDataset(const std::string& imagesPath, const std::string& labelsPath,
+                               DatasetType type = DatasetType::MNIST);
 };
 
 #endif
@@ -80,7 +80,7 @@ void Renderer::drawSphere(float x, float y, float z, float r, float g, float b,
     glPopMatrix();
 }
 
-void Renderer::drawMNISTImageOnSphere(float x, float y, float z, const std::vector<float>& imageData, float radius) {
+void Renderer::drawMNISTImageOnSphere(float x, float y, float z, const float* imageData, float radius) {
     glPushMatrix();
     glTranslatef(x, y, z);
 
@@ -139,8 +139,7 @@ void Renderer::display() {
 
     instance->drawCubeWireframe();
 
-    const auto& neurons = instance->network->getNeurons();
-    for (const auto& neuron : neurons) {
+    for (const NeuronView& neuron : instance->network->getNeurons()) {
         if (instance->showImages) {
             // Show MNIST prototype images
             instance->drawMNISTImageOnSphere(neuron.x, neuron.y, neuron.z,
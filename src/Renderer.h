@@ -31,7 +31,7 @@ private:
     void drawCubeWireframe();
     void drawSphere(float x, float y, float z, float r, float g, float b, float radius = 0.08f);
     void drawTexturedSphere(float x, float y, float z, const std::vector<float>& imageData, float radius = 0.08f);
-    void drawMNISTImageOnSphere(float x, float y, float z, const std::vector<float>& imageData, float radius = 0.08f);
+    void drawMNISTImageOnSphere(float x, float y, float z, const float* imageData, float radius = 0.08f);
 
     bool showImages;
 
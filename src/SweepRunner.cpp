@@ -0,0 +1,102 @@
+#include "SweepRunner.h"
+#include "DatasetStream.h"
+#include "ThreadPool.h"
+#include <chrono>
+#include <mutex>
+
+std::vector<SweepConfig> SweepRunner::expandGrid(const std::vector<int>& lattices, const std::vector<int>& epochs,
+                                                 const std::vector<float>& learningRates,
+                                                 const std::vector<float>& radii,
+                                                 const std::vector<float>& decayRates) {
+    std::vector<SweepConfig> configs;
+    for (int lattice : lattices) {
+        for (int epochCount : epochs) {
+            for (float learningRate : learningRates) {
+                for (float radius : radii) {
+                    for (float decayRate : decayRates) {
+                        configs.push_back({lattice, epochCount, {learningRate, radius, decayRate}});
+                    }
+                }
+            }
+        }
+    }
+    return configs;
+}
+
+namespace {
+// testSet() is called once a run has finished training
+template <typename TestSet>
+std::vector<SweepResult> runConfigs(const std::vector<SweepConfig>& configs, const Dataset& trainSet,
+                                    const TestSet& testSet, const SweepOptions& options,
+                                    const std::function<void(const SweepResult&)>& onResult) {
+    std::vector<SweepResult> results(configs.size());
+    if (trainSet.empty()) return results;
+
+    int inputSize = trainSet.getInputSize();
+    std::mutex resultMutex;
+
+    // Runs are the unit of parallelism: a network's own pool calls run inline
+    // on the worker that owns it
+    ThreadPool pool(options.concurrency);
+    pool.parallelFor(configs.size(), 1, [&](size_t begin, size_t end, int) {
+        for (size_t i = begin; i < end; ++i) {
+            const SweepConfig& config = configs[i];
+            KohonenNetwork network(config.lattice, config.lattice, config.lattice, inputSize);
+            network.setNumThreads(1);
+            network.setSeed(options.seed);
+            network.setTrainingMode(options.trainingMode);
+            network.setSchedule(config.schedule);
+            network.initialize();
+
+            auto start = std::chrono::steady_clock::now();
+            TrainingHistory history = network.train(trainSet, config.epochs);
+            double trainSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            MetricsReport report = network.evaluateOnDataset(testSet());
+
+            SweepResult& result = results[i];
+            result.config = config;
+            result.epochsRun = history.epochsRun;
+            result.trainSeconds = trainSeconds;
+            result.quantizationError = Metrics::calculateQuantizationError(network.getSampleAssignments());
+            result.accuracy = report.accuracy;
+            result.averageF1 = report.averageF1;
+
+            std::lock_guard<std::mutex> lock(resultMutex);
+            if (onResult) onResult(result);
+        }
+    });
+    return results;
+}
+}
+
+std::vector<SweepResult> SweepRunner::run(const std::vector<SweepConfig>& configs,
+                                          const Dataset& trainSet,
+                                          const Dataset& testSet,
+                                          const SweepOptions& options,
+                                          const std::function<void(const SweepResult&)>& onResult) {
+    if (testSet.empty()) return std::vector<SweepResult>(configs.size());
+    return runConfigs(configs, trainSet, [&]() -> const Dataset& { return testSet; }, options, onResult);
+}
+
+std::vector<SweepResult> SweepRunner::run(const std::vector<SweepConfig>& configs,
+                                          const Dataset& trainSet,
+                                          DatasetStream& testSet,
+                                          const SweepOptions& options,
+                                          const std::function<void(const SweepResult&)>& onResult) {
+    if (testSet.size() == 0) return std::vector<SweepResult>(configs.size());
+    return runConfigs(configs, trainSet, [&]() -> const Dataset& { return testSet.wait(); }, options, onResult);
+}
+
+void SweepRunner::writeCsvHeader(std::ostream& out) {
+    out << "lattice,neurons,epochs,learning_rate,radius,decay_rate,epochs_run,train_seconds,"
+        << "quantization_error,accuracy,average_f1" << std::endl;
+}
+
+void SweepRunner::writeCsvRow(std::ostream& out, const SweepResult& result) {
+    const SweepConfig& config = result.config;
+    float radius = config.schedule.initialRadius > 0.0f ? config.schedule.initialRadius : config.lattice / 2.0f;
+    out << config.lattice << "," << config.lattice * config.lattice * config.lattice << ","
+        << config.epochs << "," << config.schedule.initialLearningRate << "," << radius << ","
+        << config.schedule.decayRate << "," << result.epochsRun << "," << result.trainSeconds << ","
+        << result.quantizationError << "," << result.accuracy << "," << result.averageF1 << std::endl;
+}
@@ -0,0 +1,60 @@
+#ifndef SWEEPRUNNER_H
+#define SWEEPRUNNER_H
+
+#include "KohonenNetwork.h"
+#include <functional>
+#include <ostream>
+#include <vector>
+
+struct SweepConfig {
+    int lattice;  // Edge length of the cubic map
+    int epochs;
+    TrainingSchedule schedule;
+};
+
+struct SweepResult {
+    SweepConfig config;
+    int epochsRun;
+    double trainSeconds;
+    float quantizationError;  // Training set, after labeling
+    float accuracy;           // Evaluation set
+    float averageF1;
+};
+
+struct SweepOptions {
+    int concurrency;  // Runs trained at once (0 = hardware concurrency)
+    TrainingMode trainingMode;
+    unsigned int seed;  // Same initial weights for every run of a given lattice
+};
+
+// Trains and scores a grid of configurations on one host. Every run is a
+// separate single-threaded network reading the same in-memory datasets, so
+// the datasets are loaded once whatever the number of runs.
+class SweepRunner {
+public:
+    // Cartesian product of the value lists
+    static std::vector<SweepConfig> expandGrid(const std::vector<int>& lattices, const std::vector<int>& epochs,
+                                               const std::vector<float>& learningRates,
+                                               const std::vector<float>& radii,
+                                               const std::vector<float>& decayRates);
+
+    // onResult is called once per finished run, never concurrently; results
+    // are returned in configuration order
+    static std::vector<SweepResult> run(const std::vector<SweepConfig>& configs,
+                                        const Dataset& trainSet,
+                                        const Dataset& testSet,
+                                        const SweepOptions& options,
+                                        const std::function<void(const SweepResult&)>& onResult);
+    // Same, with the evaluation set still loading in the background: each run
+    // waits for it only once trained
+    static std::vector<SweepResult> run(const std::vector<SweepConfig>& configs,
+                                        const Dataset& trainSet,
+                                        DatasetStream& testSet,
+                                        const SweepOptions& options,
+                                        const std::function<void(const SweepResult&)>& onResult);
+
+    static void writeCsvHeader(std::ostream& out);
+    static void writeCsvRow(std::ostream& out, const SweepResult& result);
+};
+
+#endif
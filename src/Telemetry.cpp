@@ -0,0 +1,109 @@
+#include "Telemetry.h"
+#include <fstream>
+#include <iostream>
+
+namespace {
+const int phaseCount = static_cast<int>(TelemetryPhase::Count);
+}
+
+Telemetry::Counters& Telemetry::counters() {
+    static Counters instance{};
+    return instance;
+}
+
+void Telemetry::addPhaseTime(TelemetryPhase phase, std::chrono::steady_clock::duration elapsed) {
+    int index = static_cast<int>(phase);
+    uint64_t nanos = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    counters().phaseNanos[index].fetch_add(nanos, std::memory_order_relaxed);
+    counters().phaseCalls[index].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Telemetry::recordEpoch(const EpochTelemetry& epoch) {
+    std::lock_guard<std::mutex> lock(counters().epochMutex);
+    counters().epochs.push_back(epoch);
+}
+
+double Telemetry::phaseSeconds(TelemetryPhase phase) {
+    return counters().phaseNanos[static_cast<int>(phase)].load() * 1e-9;
+}
+
+double Telemetry::samplesPerSecond() {
+    std::lock_guard<std::mutex> lock(counters().epochMutex);
+    double seconds = 0.0;
+    uint64_t samples = 0;
+    for (const EpochTelemetry& epoch : counters().epochs) {
+        seconds += epoch.seconds;
+        samples += epoch.samples;
+    }
+    return seconds > 0.0 ? samples / seconds : 0.0;
+}
+
+double Telemetry::neuronsUpdatedPerSample() {
+    uint64_t samples = counters().samplesTrained.load();
+    return samples > 0 ? static_cast<double>(counters().neuronsUpdated.load()) / samples : 0.0;
+}
+
+void Telemetry::reset() {
+    Counters& c = counters();
+    for (int i = 0; i < phaseCount; ++i) {
+        c.phaseNanos[i] = 0;
+        c.phaseCalls[i] = 0;
+    }
+    c.samplesTrained = 0;
+    c.neuronsUpdated = 0;
+    std::lock_guard<std::mutex> lock(c.epochMutex);
+    c.epochs.clear();
+}
+
+const char* Telemetry::phaseName(TelemetryPhase phase) {
+    switch (phase) {
+        case TelemetryPhase::DatasetLoad: return "dataset_load";
+        case TelemetryPhase::Shuffle: return "shuffle";
+        case TelemetryPhase::BmuSearch: return "bmu_search";
+        case TelemetryPhase::NeighborhoodUpdate: return "neighborhood_update";
+        case TelemetryPhase::Labeling: return "labeling";
+        case TelemetryPhase::Evaluation: return "evaluation";
+        default: return "unknown";
+    }
+}
+
+bool Telemetry::saveJson(const std::string& filename) {
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open file " << filename << " for writing" << std::endl;
+        return false;
+    }
+
+    Counters& c = counters();
+    double samplesRate = samplesPerSecond();
+
+    file << "{\n  \"phases\": {\n";
+    for (int i = 0; i < phaseCount; ++i) {
+        TelemetryPhase phase = static_cast<TelemetryPhase>(i);
+        file << "    \"" << phaseName(phase) << "\": {\"seconds\": " << phaseSeconds(phase)
+             << ", \"calls\": " << c.phaseCalls[i].load() << "}" << (i + 1 < phaseCount ? "," : "") << "\n";
+    }
+    file << "  },\n";
+
+    file << "  \"samples_trained\": " << c.samplesTrained.load() << ",\n";
+    file << "  \"neurons_updated\": " << c.neuronsUpdated.load() << ",\n";
+    file << "  \"samples_per_second\": " << samplesRate << ",\n";
+    file << "  \"neurons_updated_per_sample\": " << neuronsUpdatedPerSample() << ",\n";
+
+    std::lock_guard<std::mutex> lock(c.epochMutex);
+    double totalSeconds = 0.0;
+    for (const EpochTelemetry& epoch : c.epochs) {
+        totalSeconds += epoch.seconds;
+    }
+    file << "  \"mean_epoch_seconds\": " << (c.epochs.empty() ? 0.0 : totalSeconds / c.epochs.size()) << ",\n";
+
+    file << "  \"epochs\": [";
+    for (size_t i = 0; i < c.epochs.size(); ++i) {
+        const EpochTelemetry& epoch = c.epochs[i];
+        file << (i == 0 ? "\n" : ",\n") << "    {\"epoch\": " << epoch.epoch << ", \"seconds\": " << epoch.seconds
+             << ", \"samples\": " << epoch.samples << ", \"quantization_error\": " << epoch.quantizationError << "}";
+    }
+    file << (c.epochs.empty() ? "]\n" : "\n  ]\n") << "}\n";
+
+    return file.good();
+}
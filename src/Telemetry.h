@@ -0,0 +1,72 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class TelemetryPhase {
+    DatasetLoad,
+    Shuffle,
+    BmuSearch,
+    NeighborhoodUpdate,
+    Labeling,
+    Evaluation,
+    Count
+};
+
+struct EpochTelemetry {
+    int epoch;
+    double seconds;
+    uint64_t samples;
+    float quantizationError;
+};
+
+// Process-wide training and inference instrumentation. Phase timers and
+// counters are relaxed atomics, so they can be bumped from pool workers;
+// phases timed on several threads at once add up thread time.
+class Telemetry {
+public:
+    static void addPhaseTime(TelemetryPhase phase, std::chrono::steady_clock::duration elapsed);
+    static void countSamples(uint64_t samples) { counters().samplesTrained.fetch_add(samples, std::memory_order_relaxed); }
+    static void countNeuronUpdates(uint64_t neurons) { counters().neuronsUpdated.fetch_add(neurons, std::memory_order_relaxed); }
+    static void recordEpoch(const EpochTelemetry& epoch);
+
+    static double phaseSeconds(TelemetryPhase phase);
+    static double samplesPerSecond();
+    static double neuronsUpdatedPerSample();
+
+    static void reset();
+    static bool saveJson(const std::string& filename);
+    static const char* phaseName(TelemetryPhase phase);
+
+private:
+    struct Counters {
+        std::atomic<uint64_t> phaseNanos[static_cast<int>(TelemetryPhase::Count)];
+        std::atomic<uint64_t> phaseCalls[static_cast<int>(TelemetryPhase::Count)];
+        std::atomic<uint64_t> samplesTrained;
+        std::atomic<uint64_t> neuronsUpdated;
+        std::mutex epochMutex;
+        std::vector<EpochTelemetry> epochs;
+    };
+    static Counters& counters();
+};
+
+// Adds the lifetime of the enclosing scope to a phase
+class ScopedTimer {
+public:
+    explicit ScopedTimer(TelemetryPhase phase) : phase(phase), start(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() { Telemetry::addPhaseTime(phase, std::chrono::steady_clock::now() - start); }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    TelemetryPhase phase;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif
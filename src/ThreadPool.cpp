@@ -0,0 +1,95 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace {
+thread_local bool insidePool = false;
+}
+
+ThreadPool::ThreadPool(int numThreads)
+: job(nullptr), jobCount(0), jobChunk(1), nextChunk(0),
+generation(0), activeWorkers(0), stopping(false) {
+
+    if (numThreads <= 0) numThreads = defaultThreadCount();
+
+    workers.reserve(numThreads - 1);
+    for (int i = 1; i < numThreads; ++i) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeCondition.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+int ThreadPool::defaultThreadCount() {
+    unsigned int hardware = std::thread::hardware_concurrency();
+    return hardware > 0 ? static_cast<int>(hardware) : 1;
+}
+
+void ThreadPool::parallelFor(size_t count, size_t minChunk, const RangeFunction& fn) {
+    if (count == 0) return;
+
+    if (workers.empty() || insidePool || count <= minChunk) {
+        fn(0, count, 0);
+        return;
+    }
+
+    // A few chunks per thread keeps the load balanced without much atomic traffic
+    size_t chunk = std::max<size_t>(minChunk, (count + size() * 4 - 1) / (size() * 4));
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &fn;
+        jobCount = count;
+        jobChunk = std::max<size_t>(chunk, 1);
+        nextChunk.store(0);
+        activeWorkers = static_cast<int>(workers.size());
+        ++generation;
+    }
+    wakeCondition.notify_all();
+
+    insidePool = true;
+    runChunks(0);
+    insidePool = false;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    doneCondition.wait(lock, [this] { return activeWorkers == 0; });
+    job = nullptr;
+}
+
+void ThreadPool::workerLoop(int worker) {
+    insidePool = true;
+    unsigned long seenGeneration = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeCondition.wait(lock, [&] { return stopping || generation != seenGeneration; });
+            if (stopping) return;
+            seenGeneration = generation;
+        }
+
+        runChunks(worker);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--activeWorkers == 0) {
+            doneCondition.notify_one();
+        }
+    }
+}
+
+void ThreadPool::runChunks(int worker) {
+    while (true) {
+        size_t begin = nextChunk.fetch_add(jobChunk);
+        if (begin >= jobCount) break;
+        size_t end = std::min(begin + jobChunk, jobCount);
+        (*job)(begin, end, worker);
+    }
+}
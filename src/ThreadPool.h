@@ -0,0 +1,51 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent pool of worker threads. The calling thread takes part in every
+// parallelFor as worker 0, so a pool of size 1 runs everything inline.
+// Only one thread may drive a given pool at a time.
+class ThreadPool {
+public:
+    typedef std::function<void(size_t begin, size_t end, int worker)> RangeFunction;
+
+    explicit ThreadPool(int numThreads = 0);  // 0 = hardware concurrency
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return static_cast<int>(workers.size()) + 1; }
+
+    // Splits [0, count) into chunks of at least minChunk items and blocks until
+    // fn has run on all of them. Calls made from inside a worker run inline.
+    void parallelFor(size_t count, size_t minChunk, const RangeFunction& fn);
+
+    static int defaultThreadCount();
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable doneCondition;
+
+    const RangeFunction* job;
+    size_t jobCount;
+    size_t jobChunk;
+    std::atomic<size_t> nextChunk;
+    unsigned long generation;
+    int activeWorkers;
+    bool stopping;
+
+    void workerLoop(int worker);
+    void runChunks(int worker);
+};
+
+#endif
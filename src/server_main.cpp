@@ -0,0 +1,86 @@
+#include "KohonenNetwork.h"
+#include "ModelFile.h"
+#include "InferenceServer.h"
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+namespace {
+InferenceServer* activeServer = nullptr;
+
+void handleSignal(int) {
+    if (activeServer) activeServer->stop();
+}
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " <model file> [--socket <path> | --stdin]"
+              << " [--batch N] [--delay-us N] [--threads N] [--int8] [--index]" << std::endl;
+}
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::string modelPath = argv[1];
+    std::string socketPath;
+    bool useStdin = false;
+    bool useInt8 = false;
+    bool useIndex = false;
+    int threads = 0;
+    InferenceServerOptions options;
+
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--socket" && hasValue) {
+            socketPath = argv[++i];
+        } else if (arg == "--stdin") {
+            useStdin = true;
+        } else if (arg == "--batch" && hasValue) {
+            options.maxBatch = static_cast<size_t>(std::atoi(argv[++i]));
+        } else if (arg == "--delay-us" && hasValue) {
+            options.maxDelayMicros = std::atoi(argv[++i]);
+        } else if (arg == "--threads" && hasValue) {
+            threads = std::atoi(argv[++i]);
+        } else if (arg == "--int8") {
+            useInt8 = true;
+        } else if (arg == "--index") {
+            useIndex = true;
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (useStdin == !socketPath.empty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // In stdin mode stdout carries the answers, so all logging goes to stderr
+    if (useStdin) {
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
+    std::unique_ptr<KohonenNetwork> network = ModelFile::load(modelPath);
+    if (!network) return 1;
+
+    network->setNumThreads(threads);
+    if (useIndex) network->setSearchIndex(true);
+    if (useInt8) network->setInferencePrecision(InferencePrecision::Int8);
+
+    InferenceServer server(*network, options);
+    activeServer = &server;
+    std::signal(SIGINT, handleSignal);
+    std::signal(SIGTERM, handleSignal);
+    // A client hanging up must not kill the server mid-write
+    std::signal(SIGPIPE, SIG_IGN);
+
+    bool ok = useStdin ? server.serveStream(STDIN_FILENO, STDOUT_FILENO) : server.serveUnixSocket(socketPath);
+    activeServer = nullptr;
+    return ok ? 0 : 1;
+}
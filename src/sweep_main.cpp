@@ -0,0 +1,154 @@
+#include "SweepRunner.h"
+#include "DatasetCache.h"
+#include "DatasetStream.h"
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace {
+template <typename T>
+std::vector<T> parseList(const std::string& text) {
+    std::vector<T> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        std::istringstream field(item);
+        T value;
+        if (field >> value) values.push_back(value);
+    }
+    return values;
+}
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " --train-images <idx> --train-labels <idx>"
+              << " [--test-images <idx> --test-labels <idx>] [--fashion] [--max-samples N]"
+              << " [--lattice 6,8,...] [--epochs 20,50,...] [--lr 0.5,...] [--radius 0,...]"
+              << " [--decay 3,...] [--mode online|batch] [--jobs N] [--seed N]"
+              << " [--output results.csv] [--cache-dir DIR] [--verbose]" << std::endl;
+}
+}
+
+int main(int argc, char** argv) {
+    std::string trainImages, trainLabels, testImages, testLabels, outputPath;
+    DatasetType datasetType = DatasetType::MNIST;
+    int maxSamples = -1;
+    bool verbose = false;
+    std::vector<int> lattices = {8};
+    std::vector<int> epochs = {50};
+    std::vector<float> learningRates = {0.5f};
+    std::vector<float> radii = {0.0f};
+    std::vector<float> decayRates = {3.0f};
+    SweepOptions options = {0, TrainingMode::Online, 1};
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--train-images" && hasValue) {
+            trainImages = argv[++i];
+        } else if (arg == "--train-labels" && hasValue) {
+            trainLabels = argv[++i];
+        } else if (arg == "--test-images" && hasValue) {
+            testImages = argv[++i];
+        } else if (arg == "--test-labels" && hasValue) {
+            testLabels = argv[++i];
+        } else if (arg == "--fashion") {
+            datasetType = DatasetType::FASHION_MNIST;
+        } else if (arg == "--max-samples" && hasValue) {
+            maxSamples = std::atoi(argv[++i]);
+        } else if (arg == "--lattice" && hasValue) {
+            lattices = parseList<int>(argv[++i]);
+        } else if (arg == "--epochs" && hasValue) {
+            epochs = parseList<int>(argv[++i]);
+        } else if (arg == "--lr" && hasValue) {
+            learningRates = parseList<float>(argv[++i]);
+        } else if (arg == "--radius" && hasValue) {
+            radii = parseList<float>(argv[++i]);
+        } else if (arg == "--decay" && hasValue) {
+            decayRates = parseList<float>(argv[++i]);
+        } else if (arg == "--mode" && hasValue) {
+            std::string mode = argv[++i];
+            if (mode != "online" && mode != "batch") {
+                printUsage(argv[0]);
+                return 1;
+            }
+            options.trainingMode = mode == "batch" ? TrainingMode::Batch : TrainingMode::Online;
+        } else if (arg == "--jobs" && hasValue) {
+            options.concurrency = std::atoi(argv[++i]);
+        } else if (arg == "--seed" && hasValue) {
+            options.seed = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--output" && hasValue) {
+            outputPath = argv[++i];
+        } else if (arg == "--cache-dir" && hasValue) {
+            DatasetCache::setDirectory(argv[++i]);
+        } else if (arg == "--verbose") {
+            verbose = true;
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (trainImages.empty() || trainLabels.empty() || testImages.empty() != testLabels.empty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::vector<SweepConfig> configs = SweepRunner::expandGrid(lattices, epochs, learningRates, radii, decayRates);
+    if (configs.empty()) {
+        std::cerr << "The parameter grid is empty" << std::endl;
+        return 1;
+    }
+
+    std::ofstream file;
+    if (!outputPath.empty()) {
+        file.open(outputPath);
+        if (!file) {
+            std::cerr << "Cannot write " << outputPath << std::endl;
+            return 1;
+        }
+    }
+
+    // The CSV stream keeps stdout's buffer while std::cout is muted: loader and
+    // training logs from concurrent runs would interleave, so only --verbose shows them
+    std::ostream out(outputPath.empty() ? std::cout.rdbuf() : file.rdbuf());
+    std::streambuf* savedLog = verbose ? nullptr : std::cout.rdbuf(nullptr);
+
+    // Both sets decode in the background at once; runs wait for the test set
+    // only when they finish training
+    std::shared_ptr<DatasetStream> trainStream =
+        DatasetStream::openIdx(trainImages, trainLabels, datasetType, maxSamples);
+    std::shared_ptr<DatasetStream> testStream;
+    if (!testImages.empty()) {
+        testStream = DatasetStream::openIdx(testImages, testLabels, datasetType, maxSamples);
+    } else {
+        std::cerr << "No test set given; scoring on the training set" << std::endl;
+    }
+    bool testMissing = !testImages.empty() && (!testStream || testStream->size() == 0);
+    if (!trainStream || trainStream->size() == 0 || testMissing) {
+        std::cerr << "Failed to load the dataset" << std::endl;
+        if (savedLog) std::cout.rdbuf(savedLog);
+        return 1;
+    }
+    const Dataset& trainSet = trainStream->wait();
+
+    std::cerr << "Running " << configs.size() << " configurations" << std::endl;
+
+    SweepRunner::writeCsvHeader(out);
+    size_t finished = 0;
+    auto report = [&](const SweepResult& result) {
+        SweepRunner::writeCsvRow(out, result);
+        std::cerr << "[" << ++finished << "/" << configs.size() << "] " << result.config.lattice << "^3, "
+                  << result.config.epochs << " epochs, lr " << result.config.schedule.initialLearningRate
+                  << ": accuracy " << result.accuracy * 100 << "%" << std::endl;
+    };
+    if (testStream) {
+        SweepRunner::run(configs, trainSet, *testStream, options, report);
+    } else {
+        SweepRunner::run(configs, trainSet, trainSet, options, report);
+    }
+
+    if (savedLog) std::cout.rdbuf(savedLog);
+    return 0;
+}
@@ -0,0 +1,39 @@
+// Batch-SOM training must give bit-identical weights and labels whatever the
+// number of threads
+#include "KohonenNetwork.h"
+#include "SyntheticData.h"
+#include <cstring>
+#include <iostream>
+
+namespace {
+const int lattice = 5;
+const int side = 8;
+const int epochs = 4;
+}
+
+int main() {
+    Dataset dataset = Dataset::fromImages(SyntheticData::generate(2000, side, side));
+    std::cout.rdbuf(nullptr);
+
+    KohonenNetwork single(lattice, lattice, lattice, side * side);
+    KohonenNetwork pooled(lattice, lattice, lattice, side * side);
+    single.setNumThreads(1);
+    pooled.setNumThreads(4);
+    for (KohonenNetwork* network : {&single, &pooled}) {
+        network->setTrainingMode(TrainingMode::Batch);
+        network->setSeed(3);
+        network->initialize();
+        network->train(dataset, epochs);
+    }
+
+    int differing = 0;
+    for (int n = 0; n < lattice * lattice * lattice; ++n) {
+        differing += std::memcmp(single.getWeights(n), pooled.getWeights(n), side * side * sizeof(float)) != 0 ||
+                     single.getNeuron(n).dominantClass != pooled.getNeuron(n).dominantClass;
+    }
+    if (differing > 0) {
+        std::cerr << differing << " neurons differ between 1 and 4 threads" << std::endl;
+        return 1;
+    }
+    return 0;
+}
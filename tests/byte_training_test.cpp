@@ -0,0 +1,73 @@
+// Training on 8-bit samples must give the same weights as training on the
+// decoded floats, on every kernel set the CPU supports and in every mode
+#include "DistanceKernels.h"
+#include "KohonenNetwork.h"
+#include "SyntheticData.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace {
+const int lattice = 4;
+const int side = 8;
+const int epochs = 3;
+
+// Trains one network on the bytes and one on the decoded Dataset; returns the
+// number of neurons whose weights differ
+int compare(const ByteMatrix& bytes, const std::vector<uint8_t>& labels, const Dataset& dataset,
+            TrainingMode mode) {
+    KohonenNetwork fromBytes(lattice, lattice, lattice, side * side);
+    KohonenNetwork fromFloats(lattice, lattice, lattice, side * side);
+    for (KohonenNetwork* network : {&fromBytes, &fromFloats}) {
+        network->setNumThreads(1);
+        network->setTrainingMode(mode);
+        network->setSeed(5);
+        network->initialize();
+    }
+    fromBytes.train(bytes, labels.data(), DatasetType::MNIST, epochs);
+    fromFloats.train(dataset, epochs);
+
+    int differing = 0;
+    for (int n = 0; n < lattice * lattice * lattice; ++n) {
+        differing += std::memcmp(fromBytes.getWeights(n), fromFloats.getWeights(n), side * side * sizeof(float)) != 0;
+        differing += fromBytes.getNeuron(n).dominantClass != fromFloats.getNeuron(n).dominantClass;
+    }
+    return differing;
+}
+}
+
+int main() {
+    std::vector<MNISTImage> images = SyntheticData::generate(300, side, side);
+    Dataset dataset = Dataset::fromImages(images);
+
+    // SyntheticData pixels are bytes / 255, so rounding recovers the bytes exactly
+    std::vector<uint8_t> pixels(images.size() * side * side);
+    std::vector<uint8_t> labels(images.size());
+    for (size_t i = 0; i < images.size(); ++i) {
+        for (int p = 0; p < side * side; ++p) {
+            pixels[i * side * side + p] = static_cast<uint8_t>(std::lround(images[i].pixels[p] * 255.0f));
+        }
+        labels[i] = static_cast<uint8_t>(images[i].label);
+    }
+    ByteMatrix bytes = {pixels.data(), images.size(), static_cast<size_t>(side * side)};
+    std::cout.rdbuf(nullptr);
+
+    int failures = 0;
+    const KernelIsa isas[] = {KernelIsa::Scalar, KernelIsa::SSE2, KernelIsa::AVX2, KernelIsa::AVX512};
+    for (KernelIsa isa : isas) {
+        if (!DistanceKernels::setIsa(isa)) continue;
+        // Batch goes through the decoded fallback
+        for (TrainingMode mode : {TrainingMode::Online, TrainingMode::Batch}) {
+            int differing = compare(bytes, labels, dataset, mode);
+            if (differing > 0) {
+                std::cerr << DistanceKernels::isaName(isa) << (mode == TrainingMode::Online ? " online: " : " batch: ")
+                          << differing << " neurons differ between byte and float training" << std::endl;
+                failures++;
+            }
+        }
+    }
+    DistanceKernels::setIsa(DistanceKernels::detectIsa());
+    return failures == 0 ? 0 : 1;
+}
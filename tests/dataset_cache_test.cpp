@@ -0,0 +1,80 @@
+// A cached dataset must be used only while its sources are unchanged: touching
+// a source or changing its size has to make the next load decode it again
+#include "DatasetCache.h"
+#include "MNISTLoader.h"
+#include "SyntheticData.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+const int side = 8;
+
+std::string images, labels;
+
+bool cached() {
+    DatasetCacheKey key;
+    return !DatasetCache::find({images, labels}, -1, key).empty();
+}
+
+// Loads through the cache and checks the result against the given samples
+bool loads(const std::vector<MNISTImage>& expected) {
+    Dataset dataset = MNISTLoader::loadDataset(images, labels);
+    if (dataset.size() != expected.size()) return false;
+    for (size_t i = 0; i < expected.size(); ++i) {
+        if (dataset.label(i) != expected[i].label ||
+            std::memcmp(dataset.sample(i), expected[i].pixels.data(), side * side * sizeof(float)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+}
+
+int main() {
+    char directory[] = "/tmp/kohonen_cache_test_XXXXXX";
+    if (!mkdtemp(directory)) return 1;
+    images = std::string(directory) + "/images.idx";
+    labels = std::string(directory) + "/labels.idx";
+    DatasetCache::setDirectory(std::string(directory) + "/cache");
+    std::cout.rdbuf(nullptr);
+
+    int failures = 0;
+    auto expect = [&failures](bool condition, const char* what) {
+        if (!condition) {
+            std::cerr << what << std::endl;
+            failures++;
+        }
+    };
+
+    std::vector<MNISTImage> first = SyntheticData::generate(200, side, side);
+    SyntheticData::writeIdx(first, side, side, images, labels);
+    expect(!cached(), "A cache entry existed before the first load");
+    expect(loads(first), "The first load returned the wrong samples");
+    expect(cached(), "The first load left no cache entry");
+    expect(loads(first), "The cached load returned the wrong samples");
+
+    // Same contents, newer modification time
+    struct timespec times[2] = {{0, UTIME_OMIT}, {0, 0}};
+    clock_gettime(CLOCK_REALTIME, &times[1]);
+    times[1].tv_sec += 10;
+    utimensat(AT_FDCWD, labels.c_str(), times, 0);
+    expect(!cached(), "The entry was used after a source was touched");
+    expect(loads(first), "The load after touching a source returned the wrong samples");
+    expect(cached(), "The load after touching a source left no fresh entry");
+
+    // More samples, so both sources change size
+    std::vector<MNISTImage> second = SyntheticData::generate(300, side, side, 10, 2);
+    SyntheticData::writeIdx(second, side, side, images, labels);
+    expect(!cached(), "The entry was used after the sources changed size");
+    expect(loads(second), "The load after resizing the sources returned the wrong samples");
+
+    std::string cleanup = std::string("rm -rf ") + directory;
+    if (std::system(cleanup.c_str()) != 0) std::cerr << "Could not remove " << directory << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,218 @@
+// Every SIMD kernel set must agree with the scalar kernels: sums to within
+// rounding, argmins on the same row (or one as close), ties to the lowest index.
+// The batch argmin is held to the same standard as the one-sample argmin; the
+// integer dot products must match exactly.
+#include "DistanceKernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace {
+const size_t lengths[] = {1, 7, 16, 17, 63, 100, 784};
+const int numRows = 37;
+const float tolerance = 1e-4f;
+
+int failures = 0;
+
+void fail(KernelIsa isa, const char* kernel, size_t n) {
+    std::cerr << DistanceKernels::isaName(isa) << " " << kernel << " disagrees with scalar for n = " << n << std::endl;
+    failures++;
+}
+
+bool close(float value, float reference) {
+    return std::fabs(value - reference) <= tolerance * std::max(1.0f, std::fabs(reference));
+}
+
+// Inputs for one length, rows padded to a multiple of 16 floats like the weights
+struct Case {
+    size_t n;
+    size_t stride;
+    std::vector<float> x;
+    std::vector<float> rows;
+    std::vector<uint8_t> bytes;
+    std::vector<int8_t> quantized;  // numRows rows of stride int8 weights
+    std::vector<float> scales;
+    std::vector<float> norms;
+
+    Case(size_t n, std::mt19937& rng) : n(n), stride((n + 15) & ~static_cast<size_t>(15)), x(n),
+    rows(numRows * stride, 0.0f), bytes(n), quantized(numRows * stride, 0), scales(numRows), norms(numRows) {
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (float& value : x) value = unit(rng);
+        for (int r = 0; r < numRows; ++r) {
+            for (size_t i = 0; i < n; ++i) rows[r * stride + i] = unit(rng);
+        }
+        for (uint8_t& value : bytes) value = static_cast<uint8_t>(rng() & 0xff);
+        for (int r = 0; r < numRows; ++r) {
+            for (size_t i = 0; i < n; ++i) quantized[r * stride + i] = static_cast<int8_t>(rng() & 0xff);
+            scales[r] = unit(rng) * 1e-3f;
+            norms[r] = unit(rng);
+        }
+        // Extremes: 255 * -128 products must not saturate in any widening step
+        std::fill(bytes.begin(), bytes.begin() + n / 2, static_cast<uint8_t>(255));
+        std::fill(quantized.begin(), quantized.begin() + n, static_cast<int8_t>(-128));
+        // Exact duplicates: every kernel must pick the first of the two
+        std::copy(rows.begin() + 3 * stride, rows.begin() + 4 * stride, rows.begin() + 20 * stride);
+    }
+};
+
+// Scalar results, recorded before switching to each SIMD set
+struct Reference {
+    std::vector<float> distances;
+    std::vector<float> distancesU8;
+    std::vector<float> blended;
+    std::vector<float> decoded;
+    std::vector<int32_t> dots;
+    int quantizedIndex;
+    float quantizedScore;
+};
+
+Reference reference(const Case& c) {
+    Reference ref;
+    for (int r = 0; r < numRows; ++r) {
+        ref.distances.push_back(DistanceKernels::squaredL2(c.x.data(), c.rows.data() + r * c.stride, c.n));
+        ref.distancesU8.push_back(DistanceKernels::squaredL2U8(c.bytes.data(), 1.0f / 255.0f,
+                                                               c.rows.data() + r * c.stride, c.n));
+    }
+    ref.blended.assign(c.rows.begin(), c.rows.begin() + c.n);
+    DistanceKernels::blendU8(ref.blended.data(), c.bytes.data(), 1.0f / 255.0f, 0.3f, c.n);
+    ref.decoded.resize(c.n);
+    DistanceKernels::decodeU8(c.bytes.data(), 255.0f, ref.decoded.data(), c.n);
+    for (int r = 0; r < numRows; ++r) {
+        ref.dots.push_back(DistanceKernels::dotU8S8(c.bytes.data(), c.quantized.data() + r * c.stride, c.n));
+    }
+    ref.quantizedIndex = DistanceKernels::argminQuantized(c.bytes.data(), c.quantized.data(), c.stride, c.n,
+                                                          c.scales.data(), c.norms.data(), numRows,
+                                                          ref.quantizedScore);
+    return ref;
+}
+
+// The chosen row must be as close as the scalar winner, and the duplicate
+// must never beat its original
+bool nearest(int index, const std::vector<float>& distances) {
+    float best = *std::min_element(distances.begin(), distances.end());
+    return index >= 0 && index < numRows && index != 20 && close(distances[index], best);
+}
+
+void check(KernelIsa isa, const Case& c, const Reference& ref) {
+    for (int r = 0; r < numRows; ++r) {
+        if (!close(DistanceKernels::squaredL2(c.x.data(), c.rows.data() + r * c.stride, c.n), ref.distances[r])) {
+            fail(isa, "squaredL2", c.n);
+            break;
+        }
+    }
+    for (int r = 0; r < numRows; ++r) {
+        if (!close(DistanceKernels::squaredL2U8(c.bytes.data(), 1.0f / 255.0f, c.rows.data() + r * c.stride, c.n),
+                   ref.distancesU8[r])) {
+            fail(isa, "squaredL2U8", c.n);
+            break;
+        }
+    }
+
+    float distance;
+    if (!nearest(DistanceKernels::argminSquaredL2(c.x.data(), c.rows.data(), c.stride, c.n, 0, numRows, distance),
+                 ref.distances)) {
+        fail(isa, "argminSquaredL2", c.n);
+    }
+    if (!nearest(DistanceKernels::argminSquaredL2U8(c.bytes.data(), 1.0f / 255.0f, c.rows.data(), c.stride, c.n, 0,
+                                                    numRows, distance), ref.distancesU8)) {
+        fail(isa, "argminSquaredL2U8", c.n);
+    }
+
+    // Pruned search in natural and reversed block order, then with a bound no
+    // row is within
+    std::vector<uint32_t> reversed;
+    for (size_t offset = 0; offset < c.n; offset += DistanceKernels::pruneBlockSize) {
+        reversed.insert(reversed.begin(), static_cast<uint32_t>(offset));
+    }
+    const uint32_t* orders[] = {nullptr, reversed.data()};
+    for (const uint32_t* order : orders) {
+        distance = std::numeric_limits<float>::max();
+        if (!nearest(DistanceKernels::argminSquaredL2Pruned(c.x.data(), c.rows.data(), c.stride, c.n, order, 0,
+                                                            numRows, distance), ref.distances)) {
+            fail(isa, "argminSquaredL2Pruned", c.n);
+        }
+    }
+    distance = *std::min_element(ref.distances.begin(), ref.distances.end()) * 0.5f;
+    if (DistanceKernels::argminSquaredL2Pruned(c.x.data(), c.rows.data(), c.stride, c.n, nullptr, 0, numRows,
+                                               distance) != -1) {
+        fail(isa, "argminSquaredL2Pruned bound", c.n);
+    }
+
+    std::vector<float> blended(c.rows.begin(), c.rows.begin() + c.n);
+    DistanceKernels::blendU8(blended.data(), c.bytes.data(), 1.0f / 255.0f, 0.3f, c.n);
+    for (size_t i = 0; i < c.n; ++i) {
+        if (!close(blended[i], ref.blended[i])) {
+            fail(isa, "blendU8", c.n);
+            break;
+        }
+    }
+    // Batches of every tile remainder; samples that are rows themselves tie
+    // rows 3 and 20 at distance 0
+    std::vector<float> norms(numRows);
+    DistanceKernels::squaredNorms(c.rows.data(), c.stride, c.n, numRows, norms.data());
+    const float* samples[13];
+    for (int s = 0; s < 13; ++s) samples[s] = s == 0 ? c.x.data() : c.rows.data() + ((s * 3) % numRows) * c.stride;
+    for (size_t count : {1, 4, 5, 13}) {
+        int bestIndex[13];
+        float bestDistance[13];
+        DistanceKernels::argminSquaredL2Batch(samples, count, c.rows.data(), c.stride, norms.data(), c.n, numRows,
+                                              bestIndex, bestDistance);
+        for (size_t s = 0; s < count; ++s) {
+            std::vector<float> distances(numRows);
+            for (int r = 0; r < numRows; ++r) {
+                distances[r] = DistanceKernels::squaredL2(samples[s], c.rows.data() + r * c.stride, c.n);
+            }
+            float best = *std::min_element(distances.begin(), distances.end());
+            if (!nearest(bestIndex[s], distances) || !close(bestDistance[s], best)) {
+                fail(isa, "argminSquaredL2Batch", c.n);
+                break;
+            }
+        }
+    }
+
+    // Division is correctly rounded everywhere, so decoding is exact
+    std::vector<float> decoded(c.n);
+    DistanceKernels::decodeU8(c.bytes.data(), 255.0f, decoded.data(), c.n);
+    if (decoded != ref.decoded) {
+        fail(isa, "decodeU8", c.n);
+    }
+
+    for (int r = 0; r < numRows; ++r) {
+        if (DistanceKernels::dotU8S8(c.bytes.data(), c.quantized.data() + r * c.stride, c.n) != ref.dots[r]) {
+            fail(isa, "dotU8S8", c.n);
+            break;
+        }
+    }
+    float score;
+    int index = DistanceKernels::argminQuantized(c.bytes.data(), c.quantized.data(), c.stride, c.n, c.scales.data(),
+                                                 c.norms.data(), numRows, score);
+    if (index != ref.quantizedIndex || score != ref.quantizedScore) {
+        fail(isa, "argminQuantized", c.n);
+    }
+}
+}
+
+int main() {
+    std::mt19937 rng(7);
+    std::vector<Case> cases;
+    for (size_t n : lengths) cases.emplace_back(n, rng);
+
+    DistanceKernels::setIsa(KernelIsa::Scalar);
+    std::vector<Reference> references;
+    for (const Case& c : cases) references.push_back(reference(c));
+
+    const KernelIsa isas[] = {KernelIsa::Scalar, KernelIsa::SSE2, KernelIsa::AVX2, KernelIsa::AVX512};
+    for (KernelIsa isa : isas) {
+        if (!DistanceKernels::setIsa(isa)) {
+            std::cout << DistanceKernels::isaName(isa) << " not supported here, skipped" << std::endl;
+            continue;
+        }
+        for (size_t i = 0; i < cases.size(); ++i) check(isa, cases[i], references[i]);
+    }
+    DistanceKernels::setIsa(DistanceKernels::detectIsa());
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,71 @@
+// MetricTree::nearest must return exactly what a linear scan returns, including
+// the lowest index when rows tie
+#include "DistanceKernels.h"
+#include "MetricTree.h"
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+// Enough rows to be indexed, clustered tightly enough for the tree to prune
+const int numRows = 6000;
+const int numClusters = 40;
+const size_t dimensions = 20;
+const size_t stride = 32;
+const int numQueries = 600;
+}
+
+int main() {
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::normal_distribution<float> noise(0.0f, 0.02f);
+
+    std::vector<float> centers(numClusters * dimensions);
+    for (float& value : centers) value = unit(rng);
+    std::vector<float> rows(numRows * stride, 0.0f);
+    for (int r = 0; r < numRows; ++r) {
+        const float* center = &centers[(r % numClusters) * dimensions];
+        for (size_t i = 0; i < dimensions; ++i) rows[r * stride + i] = center[i] + noise(rng);
+    }
+    // Every 7th row repeats an earlier one, so queries on it tie at distance 0
+    for (int r = 7; r < numRows; r += 7) {
+        std::copy(&rows[(r / 7) * stride], &rows[(r / 7) * stride] + stride, &rows[r * stride]);
+    }
+
+    MetricTree tree;
+    tree.build(rows.data(), stride, dimensions, numRows);
+
+    int mismatches = 0;
+    std::vector<float> query(dimensions);
+    for (int q = 0; q < numQueries; ++q) {
+        if (q % 2 == 0) {
+            const float* center = &centers[(q % numClusters) * dimensions];
+            for (size_t i = 0; i < dimensions; ++i) query[i] = center[i] + noise(rng);
+        } else {
+            const float* row = &rows[((q * 7) % numRows) * stride];
+            query.assign(row, row + dimensions);
+        }
+
+        float treeDistance, scanDistance;
+        int treeIndex = tree.nearest(query.data(), treeDistance);
+        int scanIndex = DistanceKernels::argminSquaredL2(query.data(), rows.data(), stride, dimensions, 0, numRows,
+                                                         scanDistance);
+        if (treeIndex != scanIndex || treeDistance != scanDistance) {
+            if (mismatches++ < 5) {
+                std::cerr << "Query " << q << ": tree found row " << treeIndex << " at " << treeDistance
+                          << ", scan row " << scanIndex << " at " << scanDistance << std::endl;
+            }
+        }
+    }
+
+    MetricTreeStats stats = tree.getStats();
+    if (stats.bruteForce) {
+        std::cerr << "The tree fell back to a linear scan, so it was not tested" << std::endl;
+        return 1;
+    }
+    if (mismatches > 0) {
+        std::cerr << mismatches << " of " << numQueries << " queries differ from a linear scan" << std::endl;
+        return 1;
+    }
+    return 0;
+}
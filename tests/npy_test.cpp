@@ -0,0 +1,164 @@
+// NpyFile must read every header version, byte order and memory order it
+// accepts into the same C-order floats, and reject what it does not support
+#include "NpyFile.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+// A (4, 2, 3) array whose element (r, i, j) is 50 r + 10 i + j, small enough for any dtype
+const size_t shape[] = {4, 2, 3};
+const size_t numRows = 4;
+const size_t rowSize = 6;
+
+float element(size_t r, size_t i, size_t j) {
+    return static_cast<float>(50 * r + 10 * i + j);
+}
+
+struct Format {
+    int version;
+    const char* descr;
+    bool fortranOrder;
+};
+
+template <typename T>
+void append(std::string& payload, float value, bool bigEndian) {
+    T typed = static_cast<T>(value);
+    unsigned char bytes[sizeof(T)];
+    std::memcpy(bytes, &typed, sizeof(T));
+    const uint16_t probe = 1;
+    bool hostLittle = *reinterpret_cast<const unsigned char*>(&probe) == 1;
+    for (size_t b = 0; b < sizeof(T); ++b) {
+        payload += static_cast<char>(bytes[bigEndian == hostLittle ? sizeof(T) - 1 - b : b]);
+    }
+}
+
+void appendElement(std::string& payload, const std::string& descr, float value) {
+    bool bigEndian = descr[0] == '>';
+    std::string type = descr.substr(1);
+    if (type == "u1") append<uint8_t>(payload, value, bigEndian);
+    else if (type == "i2") append<int16_t>(payload, value, bigEndian);
+    else if (type == "u4") append<uint32_t>(payload, value, bigEndian);
+    else if (type == "i8") append<int64_t>(payload, value, bigEndian);
+    else if (type == "f4") append<float>(payload, value, bigEndian);
+    else append<double>(payload, value, bigEndian);
+}
+
+// Header padded so the payload starts on a 64-byte boundary, as numpy writes it
+std::string encode(const Format& format) {
+    std::string header = std::string("{'descr': '") + format.descr + "', 'fortran_order': " +
+                         (format.fortranOrder ? "True" : "False") + ", 'shape': (4, 2, 3), }";
+    size_t prefix = format.version == 1 ? 10 : 12;
+    header.append((64 - (prefix + header.size() + 1) % 64) % 64, ' ');
+    header += '\n';
+
+    std::string file = "\x93NUMPY";
+    file += static_cast<char>(format.version);
+    file += '\0';
+    for (size_t b = 0; b < prefix - 8; ++b) file += static_cast<char>((header.size() >> (8 * b)) & 0xff);
+    file += header;
+
+    // C order varies the last index fastest, Fortran order the first
+    for (size_t a = 0; a < shape[0] * shape[1] * shape[2]; ++a) {
+        size_t r, i, j;
+        if (format.fortranOrder) {
+            r = a % shape[0];
+            i = a / shape[0] % shape[1];
+            j = a / (shape[0] * shape[1]);
+        } else {
+            r = a / (shape[1] * shape[2]);
+            i = a / shape[2] % shape[1];
+            j = a % shape[2];
+        }
+        appendElement(file, format.descr, element(r, i, j));
+    }
+    return file;
+}
+
+bool write(const std::string& path, const std::string& contents) {
+    std::ofstream file(path, std::ios::binary);
+    file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+    return file.good();
+}
+
+bool check(const Format& format, const std::string& path) {
+    std::string name = std::string("v") + std::to_string(format.version) + " " + format.descr +
+                       (format.fortranOrder ? " Fortran" : " C");
+    std::shared_ptr<NpyFile> npy = write(path, encode(format)) ? NpyFile::open(path) : nullptr;
+    if (!npy) {
+        std::cerr << name << ": rejected" << std::endl;
+        return false;
+    }
+    if (npy->count() != numRows || npy->rowSize() != rowSize || npy->isFortranOrder() != format.fortranOrder) {
+        std::cerr << name << ": wrong shape or order" << std::endl;
+        return false;
+    }
+
+    // All rows, then rows 1 and 2 alone into a padded stride
+    const size_t stride = 8;
+    std::vector<float> all(numRows * stride, -1.0f);
+    std::vector<float> middle(2 * stride, -1.0f);
+    npy->readRows(0, numRows, all.data(), stride);
+    npy->readRows(1, 3, middle.data(), stride, 2.0f);
+    for (size_t r = 0; r < numRows; ++r) {
+        for (size_t e = 0; e < rowSize; ++e) {
+            float expected = element(r, e / shape[2], e % shape[2]);
+            bool wrong = all[r * stride + e] != expected ||
+                         (r >= 1 && r < 3 && middle[(r - 1) * stride + e] != expected / 2.0f);
+            if (wrong) {
+                std::cerr << name << ": element " << e << " of row " << r << " is " << all[r * stride + e]
+                          << ", expected " << expected << std::endl;
+                return false;
+            }
+        }
+    }
+
+    // Only a native C-order array can be read in place
+    bool native = !format.fortranOrder && format.descr[0] != '>';
+    bool inPlace = std::strcmp(format.descr + 1, "f4") == 0 ? npy->view<float>() != nullptr
+                   : std::strcmp(format.descr + 1, "u1") == 0 ? npy->matrix().data != nullptr
+                   : native;
+    if (inPlace != native) {
+        std::cerr << name << ": in-place view " << (inPlace ? "offered" : "missing") << std::endl;
+        return false;
+    }
+    return true;
+}
+}
+
+int main() {
+    const Format formats[] = {
+        {1, "<f4", false}, {2, "<f4", false}, {3, "<f4", false},
+        {1, ">f4", false}, {2, ">f8", false}, {1, ">i2", false}, {3, ">u4", false},
+        {1, "<f4", true}, {2, "|u1", true}, {3, ">i8", true}, {1, "<f8", true},
+        {1, "|u1", false},
+    };
+    std::string path = "/tmp/kohonen_npy_test_" + std::to_string(getpid()) + ".npy";
+
+    int failures = 0;
+    for (const Format& format : formats) {
+        failures += !check(format, path);
+    }
+
+    // Unknown versions and short payloads must be refused (quietly, here)
+    std::string future = encode({1, "<f4", false});
+    future[6] = 4;
+    std::string truncated = encode({2, "<f4", false});
+    truncated.resize(truncated.size() - 1);
+    for (const std::string& contents : {future, truncated}) {
+        std::streambuf* errors = std::cerr.rdbuf(nullptr);
+        bool accepted = write(path, contents) && NpyFile::open(path);
+        std::cerr.rdbuf(errors);
+        if (accepted) {
+            std::cerr << "A malformed NPY file was accepted" << std::endl;
+            failures++;
+        }
+    }
+    std::remove(path.c_str());
+    return failures == 0 ? 0 : 1;
+}
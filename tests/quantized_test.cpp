@@ -0,0 +1,41 @@
+// Frozen int8 inference must stay close to float inference: at least
+// minAgreement of the samples get the same BMU and the accuracy moves by at
+// most maxAccuracyDrop, on every kernel set the CPU supports
+#include "DistanceKernels.h"
+#include "KohonenNetwork.h"
+#include "SyntheticData.h"
+#include <iostream>
+
+namespace {
+const int lattice = 5;
+const int side = 28;
+const float minAgreement = 0.95f;
+const float maxAccuracyDrop = 0.01f;
+}
+
+int main() {
+    Dataset train = Dataset::fromImages(SyntheticData::generate(2000, side, side));
+    Dataset test = Dataset::fromImages(SyntheticData::generate(500, side, side, 10, 2));
+    std::cout.rdbuf(nullptr);
+
+    KohonenNetwork network(lattice, lattice, lattice, side * side);
+    network.setSeed(3);
+    network.initialize();
+    network.train(train, 4);
+    network.freezeQuantized();
+
+    int failures = 0;
+    const KernelIsa isas[] = {KernelIsa::Scalar, KernelIsa::SSE2, KernelIsa::AVX2, KernelIsa::AVX512};
+    for (KernelIsa isa : isas) {
+        if (!DistanceKernels::setIsa(isa)) continue;
+        QuantizationDrift drift = network.measureQuantizationDrift(test);
+        if (drift.agreement < minAgreement || drift.quantizedAccuracy < drift.floatAccuracy - maxAccuracyDrop) {
+            std::cerr << DistanceKernels::isaName(isa) << ": int8 BMU agreement " << drift.agreement
+                      << ", accuracy " << drift.quantizedAccuracy << " vs " << drift.floatAccuracy << " in float"
+                      << std::endl;
+            failures++;
+        }
+    }
+    DistanceKernels::setIsa(DistanceKernels::detectIsa());
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,73 @@
+// Resuming from a mid-run checkpoint must give the same weights as training
+// straight through, in every training mode
+#include "KohonenNetwork.h"
+#include "SyntheticData.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+namespace {
+const int lattice = 4;
+const int side = 8;
+const int epochs = 4;
+
+struct ModeCase {
+    const char* name;
+    TrainingMode mode;
+    bool approximate;
+    bool pruned;
+};
+
+void configure(KohonenNetwork& network, const ModeCase& mode) {
+    network.setNumThreads(1);  // Hogwild is only reproducible on one thread
+    network.setTrainingMode(mode.mode);
+    if (mode.approximate) network.setApproximateSearch(true, 2);
+    network.setPrunedSearch(mode.pruned);
+}
+}
+
+int main() {
+    const ModeCase modes[] = {
+        {"online", TrainingMode::Online, false, false},
+        {"batch", TrainingMode::Batch, false, false},
+        {"hogwild", TrainingMode::Hogwild, false, false},
+        {"approximate", TrainingMode::Online, true, false},
+        {"pruned", TrainingMode::Online, false, true},
+    };
+
+    Dataset dataset = Dataset::fromImages(SyntheticData::generate(300, side, side));
+    std::cout.rdbuf(nullptr);
+
+    int failures = 0;
+    for (const ModeCase& mode : modes) {
+        std::string checkpoint = "/tmp/kohonen_resume_test_" + std::to_string(getpid()) + "_" + mode.name;
+
+        // The last epoch is never checkpointed, so this leaves the one after epoch 2
+        KohonenNetwork reference(lattice, lattice, lattice, side * side);
+        configure(reference, mode);
+        reference.setSeed(9);
+        reference.initialize();
+        reference.setCheckpointing(checkpoint, 2);
+        reference.train(dataset, epochs);
+
+        KohonenNetwork resumed(lattice, lattice, lattice, side * side);
+        configure(resumed, mode);
+        resumed.setSeed(1);
+        resumed.initialize();
+        bool loaded = resumed.resumeTraining(dataset, checkpoint);
+        std::remove(checkpoint.c_str());
+
+        int differing = 0;
+        for (int n = 0; loaded && n < lattice * lattice * lattice; ++n) {
+            differing += std::memcmp(reference.getWeights(n), resumed.getWeights(n), side * side * sizeof(float)) != 0;
+        }
+        if (!loaded || differing > 0) {
+            std::cerr << mode.name << ": " << (loaded ? std::to_string(differing) + " neurons differ after resume"
+                                                      : std::string("checkpoint was rejected")) << std::endl;
+            failures++;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}